@@ -1,8 +1,13 @@
 #pragma once
 #include "../util/critical_pair.h"
+#include "util/divisor_index.h"
 #include "util/groebner_basis_util.h"
 #include "util/matrix_reduction.h"
 #include <cassert>
+#include <iterator>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace FF4 {
     namespace NAlgo {
@@ -11,92 +16,328 @@ namespace FF4 {
             template <typename TCoef, typename TComp>
             using TPairsVector = std::vector<NUtils::CriticalPair<TCoef, TComp>>;
 
+            // Options of FindGroebnerBasis, matrix applies to the reduction of every matrix.
+            struct TOptions {
+                NUtil::TMatrixReductionOptions matrix;
+                // Keeps the fully reduced pivot rows met twice in the reduction of their matrix and starts later
+                // reducers from them (Faugere's Simplify).
+                // Pivot rows are reduced only with the reduced echelon form.
+                bool simplify = false;
+                // Reducers of symbolic preprocessing, they are simplified afterwards if simplify is set.
+                NUtil::EReducerChoice reducer = NUtil::EReducerChoice::Least;
+                // Pairs taken in a step, at most max_pairs of them if positive. A smaller cap gives more and smaller
+                // matrices.
+                NUtil::ESelectionStrategy selection = NUtil::ESelectionStrategy::Normal;
+                size_t max_pairs = 0;
+            };
+
+            // Fully reduced pivot rows of the previous matrices, the latest one for every product. products[f] lists
+            // the multipliers u with the reduced row p with the leading term of u * f for a basis element f, by
+            // decreasing degree of u, origins maps a stored row back to f. A row is freed when no product refers
+            // to it any more.
+            template <typename TCoef, typename TComp>
+            struct TSimplifyTable {
+                using TRow = std::shared_ptr<const NUtils::Polynomial<TCoef, TComp>>;
+
+                struct TProduct {
+                    NUtils::Term multiplier;
+                    uint64_t mask; // DivisibilityMask of the multiplier
+                    TRow row;
+                };
+
+                std::unordered_map<const NUtils::Polynomial<TCoef, TComp>*, std::vector<TProduct>> products;
+                std::unordered_map<const NUtils::Polynomial<TCoef, TComp>*, const NUtils::Polynomial<TCoef, TComp>*> origins;
+            };
+
+            // Faugere's Simplify: replaces the product t * f by t / u * p for the reduced row p of u * f with the
+            // largest known divisor u of t. Rows are stored for basis elements only, so one lookup finds the best.
+            // The multipliers are sorted by degree, the first one dividing t is taken.
             template <typename TCoef, typename TComp>
-            TPairsVector<TCoef, TComp> Select(NUtil::TPairsSet<TCoef, TComp>& pairs_to_check) {
+            std::pair<const NUtils::Polynomial<TCoef, TComp>*, NUtils::Term> Simplify(const NUtils::Polynomial<TCoef, TComp>* f, NUtils::Term t, const TSimplifyTable<TCoef, TComp>& table) {
+                auto it = table.products.find(f);
+                if (it == table.products.end()) {
+                    return {f, t};
+                }
+                const uint64_t mask = NUtils::DivisibilityMask(t);
+                for (const auto& product : it->second) {
+                    if (product.multiplier.TotalDegree() > t.TotalDegree()) {
+                        continue;
+                    }
+                    if ((product.mask & ~mask) == 0 && t.IsDivisibleBy(product.multiplier)) {
+                        t /= product.multiplier;
+                        return {product.row.get(), t};
+                    }
+                }
+                return {f, t};
+            }
+
+            // Stores the reduced pivot rows of the matrix of rows under the products of basis elements they stand for,
+            // a row simplified to v * p stands for the product of the basis element of p with the same leading term.
+            // A newer row replaces the one stored for the same product.
+            template <typename TCoef, typename TComp>
+            void UpdateSimplifyTable(TSimplifyTable<TCoef, TComp>& table, const NUtil::TMultipliedRows<TCoef, TComp>& rows, NUtils::TPolynomials<TCoef, TComp>& reduced_pivots) {
+                using TRow = typename TSimplifyTable<TCoef, TComp>::TRow;
+                NUtils::TermHashMap<size_t> pivot_of_term;
+                pivot_of_term.Reserve(reduced_pivots.size());
+                for (size_t i = 0; i < reduced_pivots.size(); i++) {
+                    pivot_of_term.Insert(reduced_pivots[i].GetLeadingTerm(), i);
+                }
+                // Basis elements are looked up before any stored row is replaced and freed.
+                std::vector<std::pair<const NUtils::Polynomial<TCoef, TComp>*, size_t>> updates;
+                for (const auto& [f, u, leading] : rows) {
+                    const size_t* pivot = pivot_of_term.Find(leading);
+                    if (!pivot) {
+                        continue;
+                    }
+                    auto origin = table.origins.find(f);
+                    updates.emplace_back(origin == table.origins.end() ? f : origin->second, *pivot);
+                }
+                std::vector<TRow> stored(reduced_pivots.size());
+                std::vector<TRow> replaced;
+                for (const auto& [f, i] : updates) {
+                    if (!stored[i]) {
+                        stored[i] = std::make_shared<const NUtils::Polynomial<TCoef, TComp>>(std::move(reduced_pivots[i]));
+                        table.origins.emplace(stored[i].get(), f);
+                    }
+                    const NUtils::Term u = stored[i]->GetLeadingTerm() / f->GetLeadingTerm();
+                    const uint64_t mask = NUtils::DivisibilityMask(u);
+                    auto& products = table.products[f];
+                    auto it = std::find_if(products.begin(), products.end(), [&](const auto& product) { return product.mask == mask && product.multiplier == u; });
+                    if (it == products.end()) {
+                        auto position = std::find_if(products.begin(), products.end(), [&u](const auto& product) { return product.multiplier.TotalDegree() < u.TotalDegree(); });
+                        products.insert(position, {u, mask, stored[i]});
+                    } else if (it->row != stored[i]) {
+                        replaced.push_back(std::move(it->row));
+                        it->row = stored[i];
+                    }
+                }
+                stored.clear();
+                std::sort(replaced.begin(), replaced.end());
+                replaced.erase(std::unique(replaced.begin(), replaced.end()), replaced.end());
+                for (const auto& row : replaced) {
+                    if (row.use_count() == 1) {
+                        table.origins.erase(row.get());
+                    }
+                }
+            }
+
+            // Takes the pairs of the lowest degree of the queue strategy, at most max_pairs of them if positive.
+            // sugar is set to the largest sugar degree of the taken pairs, the sugar of the new polynomials.
+            template <typename TCoef, typename TComp>
+            TPairsVector<TCoef, TComp> Select(NUtil::CriticalPairQueue<TCoef, TComp>& pairs_to_check, size_t max_pairs, NUtils::Term::Degree& sugar) {
+                std::vector<typename NUtil::CriticalPairQueue<TCoef, TComp>::TPair> pairs;
+                pairs_to_check.TakeLowest(pairs, max_pairs);
                 TPairsVector<TCoef, TComp> selectionGroup;
-                NUtils::Term::Degree value = pairs_to_check.begin()->TotalDegree();
-                while(pairs_to_check.size() && pairs_to_check.begin()->TotalDegree() == value) {
-                    selectionGroup.push_back(*pairs_to_check.begin());
-                    pairs_to_check.erase(pairs_to_check.begin());
+                selectionGroup.reserve(pairs.size());
+                sugar = 0;
+                for (const auto& pair : pairs) {
+                    selectionGroup.emplace_back(pairs_to_check.GetLeft(pair), pairs_to_check.GetRight(pair));
+                    sugar = std::max(sugar, pair.sugar);
                 }
                 return selectionGroup;
             }
 
+            // Product u * f as (f, u * LT(f)).
             template <typename TCoef, typename TComp>
-            void UpdateL(NUtils::TPolynomials<TCoef, TComp>& L, const NUtils::Term& term, const NUtil::TPolynomialSet<TCoef, TComp>& polynomials, NUtil::TTermHashSet& diff, NUtil::TTermHashSet& done) {
-                for (const auto& polynomial : polynomials) {
-                    const auto& t = polynomial.GetLeadingTerm();
-                    if (term.IsDivisibleBy(t)) {
-                        NUtils::Polynomial<TCoef, TComp> reducer = (term / t) * polynomial;
-                        L.push_back(std::move(reducer));
-                        for (const auto& m : L.back().GetMonomials()) {
-                            if (!done.contains(m.GetTerm())) {
-                                diff.insert(m.GetTerm());
-                            }
+            using TProductKey = std::pair<const NUtils::Polynomial<TCoef, TComp>*, NUtils::Term>;
+
+            struct TProductKeyHasher {
+                template <typename TKey>
+                size_t operator()(const TKey& key) const noexcept {
+                    return std::hash<const void*>()(key.first) ^ (NUtils::TermHasher()(key.second) * 0x9e3779b97f4a7c15ull);
+                }
+            };
+
+            // Appends the row u * f to L, simplified if a table is given.
+            template <typename TCoef, typename TComp>
+            void PushRow(NUtil::TMultipliedRows<TCoef, TComp>& L, const NUtils::Polynomial<TCoef, TComp>& f, const NUtils::Term& u, const TSimplifyTable<TCoef, TComp>* table) {
+                if (!table) {
+                    L.push_back({&f, u, u * f.GetLeadingTerm()});
+                    return;
+                }
+                auto [p, v] = Simplify(&f, u, *table);
+                L.push_back({p, v, v * p->GetLeadingTerm()});
+            }
+
+            // Adds the reducer of term, if any, to L and the terms of its row to columns.
+            template <typename TCoef, typename TComp>
+            void UpdateL(NUtil::TMultipliedRows<TCoef, TComp>& L, const NUtils::Term& term, const NUtil::DivisorIndex<TCoef, TComp>& divisors, NUtils::TermHashSet& columns, const TSimplifyTable<TCoef, TComp>* table = nullptr, NUtil::EReducerChoice choice = NUtil::EReducerChoice::Least) {
+                const NUtils::Polynomial<TCoef, TComp>* polynomial = divisors.FindDivisor(term, choice);
+                if (!polynomial) {
+                    return;
+                }
+                PushRow(L, *polynomial, term / polynomial->GetLeadingTerm(), table);
+                NUtils::Term product;
+                for (const auto& m : L.back().polynomial->GetMonomials()) {
+                    L.back().GetTerm(m, product);
+                    columns.Insert(product);
+                }
+            }
+
+            // UpdateL for the terms of known from first[s] on in shard s and for the new terms their reducers bring,
+            // in rounds. Reducers of the terms of a round are found in parallel chunk by chunk, then their new terms
+            // are merged into the shards, one task per shard. Every term gets the reducer it gets from UpdateL and rows
+            // are appended in the order of the chunks.
+            template <typename TCoef, typename TComp>
+            void ParallelUpdateL(NUtil::TMultipliedRows<TCoef, TComp>& L, std::vector<NUtils::TermHashSet>& known, std::vector<size_t> first, const NUtil::DivisorIndex<TCoef, TComp>& divisors, NUtils::ThreadPool& pool, const TSimplifyTable<TCoef, TComp>* table = nullptr, NUtil::EReducerChoice choice = NUtil::EReducerChoice::Least) {
+                const size_t shards = known.size();
+                std::vector<std::pair<size_t, size_t>> frontier; // (shard, index)
+                while (true) {
+                    frontier.clear();
+                    for (size_t s = 0; s < shards; s++) {
+                        for (; first[s] < known[s].Size(); first[s]++) {
+                            frontier.emplace_back(s, first[s]);
                         }
+                    }
+                    if (frontier.empty()) {
                         break;
                     }
+
+                    const size_t chunk = std::max<size_t>(1, frontier.size() / (pool.Size() * 8));
+                    const size_t tasks = (frontier.size() + chunk - 1) / chunk;
+                    std::vector<NUtil::TMultipliedRows<TCoef, TComp>> rows(tasks);
+                    std::vector<std::vector<std::vector<NUtils::Term>>> found(tasks, std::vector<std::vector<NUtils::Term>>(shards));
+                    pool.ParallelFor(tasks, [&](size_t, size_t task) {
+                        NUtils::Term term, product;
+                        for (size_t i = task * chunk; i < std::min(frontier.size(), (task + 1) * chunk); i++) {
+                            known[frontier[i].first].Get(frontier[i].second, term);
+                            const NUtils::Polynomial<TCoef, TComp>* polynomial = divisors.FindDivisor(term, choice);
+                            if (!polynomial) {
+                                continue;
+                            }
+                            PushRow(rows[task], *polynomial, term / polynomial->GetLeadingTerm(), table);
+                            const auto& row = rows[task].back();
+                            for (const auto& m : row.polynomial->GetMonomials()) {
+                                row.GetTerm(m, product);
+                                const size_t shard = NUtils::TermHasher()(product) % shards;
+                                if (!known[shard].Contains(product)) {
+                                    found[task][shard].push_back(product);
+                                }
+                            }
+                        }
+                    });
+
+                    pool.ParallelFor(shards, [&](size_t, size_t shard) {
+                        for (const auto& terms : found) {
+                            for (const auto& term : terms[shard]) {
+                                known[shard].Insert(term);
+                            }
+                        }
+                    });
+                    for (auto& part : rows) {
+                        std::move(part.begin(), part.end(), std::back_inserter(L));
+                    }
                 }
             }
 
+            // Rows of L stay implicit products u * f, the product terms are built only to collect the columns.
+            // Pairs sharing a half give the same product, it enters L once. Reducers added by UpdateL have leading
+            // terms which are not in L yet, so they are distinct from the rest.
+            // The columns are collected in known, split into shards by hash when the pool has several workers. The
+            // sets are cleared here, so the caller may keep them between the calls to reuse their memory.
             template <typename TCoef, typename TComp>
-            NUtil::TSymbolicPreprocessingResult<TCoef, TComp> SymbolicPreprocessing(TPairsVector<TCoef, TComp>& selected, const NUtil::TPolynomialSet<TCoef, TComp>& polynomials) {
-                NUtils::TPolynomials<TCoef, TComp> L;
+            NUtil::TSymbolicPreprocessingResult<TCoef, TComp> SymbolicPreprocessing(TPairsVector<TCoef, TComp>& selected, const NUtil::DivisorIndex<TCoef, TComp>& divisors, NUtils::ThreadPool& pool, std::vector<NUtils::TermHashSet>& known, const TSimplifyTable<TCoef, TComp>* table = nullptr, NUtil::EReducerChoice choice = NUtil::EReducerChoice::Least, NUtil::TMatrixReductionStats* stats = nullptr) {
+                NUtil::TMultipliedRows<TCoef, TComp> L;
                 L.reserve(selected.size() * 3);
+                std::unordered_set<TProductKey<TCoef, TComp>, TProductKeyHasher> products;
+                auto push_half = [&](const NUtils::Polynomial<TCoef, TComp>& f, const NUtils::Term& u) {
+                    PushRow(L, f, u, table);
+                    if (!products.emplace(L.back().polynomial, L.back().leading).second) {
+                        L.pop_back();
+                    }
+                };
                 for (const auto& pair : selected) {
-                    L.push_back(pair.GetGlcm() / pair.GetLeftTerm() * pair.GetLeft());
-                    L.push_back(pair.GetGlcm() / pair.GetRightTerm() * pair.GetRight());
+                    push_half(pair.GetLeft(), pair.GetGlcm() / pair.GetLeftTerm());
+                    push_half(pair.GetRight(), pair.GetGlcm() / pair.GetRightTerm());
                 }
+                const size_t halves = L.size();
 
-                NUtil::TTermHashSet diff;
+                // Leading terms of the halves go first, they already have their rows. The rest waits for reducers.
+                const size_t shards = pool.Size() == 1 ? 1 : pool.Size() * 4;
+                known.resize(shards);
+                for (auto& terms : known) {
+                    terms.Clear();
+                }
+                auto shard_of = [shards](const NUtils::Term& term) {
+                    return shards == 1 ? 0 : NUtils::TermHasher()(term) % shards;
+                };
                 for (const auto& l : L) {
-                    auto it = diff.begin();
-                    for (const auto& m : l.GetMonomials()) {
-                        it = diff.insert(it, m.GetTerm());
-                    }
+                    known[shard_of(l.leading)].Insert(l.leading);
                 }
-
-                NUtil::TTermHashSet done;
+                std::vector<size_t> first(shards);
+                for (size_t s = 0; s < shards; s++) {
+                    first[s] = known[s].Size();
+                }
+                NUtils::Term product;
                 for (const auto& l : L) {
-                    diff.erase(l.GetLeadingTerm());
-                    done.insert(l.GetLeadingTerm());
+                    for (const auto& m : l.polynomial->GetMonomials()) {
+                        l.GetTerm(m, product);
+                        known[shard_of(product)].Insert(product);
+                    }
                 }
 
-                while(!diff.empty()) {
-                    const NUtils::Term& term = *diff.begin();
-                    auto extracted = diff.extract(diff.begin());
-                    done.insert(std::move(extracted));
-                    UpdateL(L, term, polynomials, diff, done);
+                if (shards == 1) {
+                    NUtils::Term term;
+                    for (size_t i = first[0]; i < known[0].Size(); i++) {
+                        known[0].Get(i, term);
+                        UpdateL(L, term, divisors, known[0], table, choice);
+                    }
+                } else {
+                    ParallelUpdateL(L, known, std::move(first), divisors, pool, table, choice);
+                }
+                if (stats) {
+                    for (size_t i = halves; i < L.size(); i++) {
+                        stats->reducers++;
+                        stats->reducer_terms += L[i].polynomial->GetMonomials().size();
+                    }
                 }
                 std::vector<NUtils::Term> done_sorted;
-                done_sorted.reserve(done.size());
-                for (auto& x : done) {
-                    done_sorted.push_back(x);
+                for (const auto& terms : known) {
+                    const size_t from = done_sorted.size();
+                    done_sorted.resize(from + terms.Size());
+                    for (size_t i = 0; i < terms.Size(); i++) {
+                        terms.Get(i, done_sorted[from + i]);
+                    }
                 }
-                std::sort(done_sorted.begin(), done_sorted.end(), TComp());
+                NUtils::SortTerms<TComp>(done_sorted, pool);
 
                 return {std::move(L), std::move(done_sorted)};
             }
 
             template <typename TCoef, typename TComp>
-            NUtils::TPolynomials<TCoef, TComp> Reduce(TPairsVector<TCoef, TComp>& selected, NUtil::TPolynomialSet<TCoef, TComp>& polynomials) {
-                NUtil::TSymbolicPreprocessingResult<TCoef, TComp> L = SymbolicPreprocessing(selected, polynomials);
-                return NUtil::MatrixReduction(L);
+            NUtils::TPolynomials<TCoef, TComp> Reduce(TPairsVector<TCoef, TComp>& selected, const NUtil::DivisorIndex<TCoef, TComp>& divisors, const TOptions& options, NUtils::ThreadPool& pool, std::vector<NUtils::TermHashSet>& known, TSimplifyTable<TCoef, TComp>* table = nullptr) {
+                NUtil::TSymbolicPreprocessingResult<TCoef, TComp> L = SymbolicPreprocessing(selected, divisors, pool, known, table, options.reducer, options.matrix.stats);
+                NUtils::TPolynomials<TCoef, TComp> reduced_pivots;
+                NUtils::TPolynomials<TCoef, TComp> reduced = NUtil::MatrixReduction(L, options.matrix, table ? &reduced_pivots : nullptr, &pool);
+                if (table) {
+                    UpdateSimplifyTable(*table, L.first, reduced_pivots);
+                }
+                return reduced;
             }
 
             template <typename TCoef, typename TComp>
-            void FindGroebnerBasis(NUtils::TPolynomials<TCoef, TComp>& F) {
+            void FindGroebnerBasis(NUtils::TPolynomials<TCoef, TComp>& F, const TOptions& options = {}) {
+                NUtils::ThreadPool pool(options.matrix.threads);
+                std::vector<NUtils::TermHashSet> known;
                 NUtil::TPolynomialSet<TCoef, TComp> polynomials;
-                NUtil::TPairsSet<TCoef, TComp> pairs_to_check;
+                NUtil::DivisorIndex<TCoef, TComp> divisors;
+                NUtil::CriticalPairQueue<TCoef, TComp> pairs_to_check(options.selection);
+                TSimplifyTable<TCoef, TComp> table;
+                const bool simplify = options.simplify && options.matrix.echelon == NUtil::EEchelonForm::Reduced;
+                auto add = [&](NUtils::Polynomial<TCoef, TComp>& g, NUtils::Term::Degree sugar) {
+                    NUtil::UpdateCriticalPairs(polynomials, pairs_to_check, g, sugar);
+                    divisors.Insert(*polynomials.find(g));
+                };
                 for (auto& f : F) {
-                    NUtil::UpdateCriticalPairs(polynomials, pairs_to_check, f);
+                    add(f, 0);
                 }
 
-                while(!pairs_to_check.empty()) {
-                    TPairsVector<TCoef, TComp> selection_group = Select(pairs_to_check);
-                    NUtils::TPolynomials<TCoef, TComp> G = Reduce(selection_group, polynomials);
+                while(!pairs_to_check.Empty()) {
+                    NUtils::Term::Degree sugar;
+                    TPairsVector<TCoef, TComp> selection_group = Select(pairs_to_check, options.max_pairs, sugar);
+                    NUtils::TPolynomials<TCoef, TComp> G = Reduce(selection_group, divisors, options, pool, known, simplify ? &table : nullptr);
                     for (auto& g : G) {
-                        NUtil::UpdateCriticalPairs(polynomials, pairs_to_check, g);
+                        add(g, sugar);
                     }
                 }
                 NUtil::UpdateBasis(polynomials, F);
@@ -1,4 +1,5 @@
 #pragma once
+#include "../util/critical_pair.h"
 #include "util/groebner_basis_util.h"
 #include <algorithm>
 #include <cassert>
@@ -9,19 +10,21 @@ namespace FF4 {
             template <typename TCoef, typename TComp>
             void FindGroebnerBasis(NUtils::TPolynomials<TCoef, TComp>& F) {
                 NUtil::TPolynomialSet<TCoef, TComp> polynomials;
-                NUtil::TPairsSet<TCoef, TComp> pairs_to_check;
+                NUtil::CriticalPairQueue<TCoef, TComp> pairs_to_check;
                 for (auto& f : F) {
                     NUtil::UpdateCriticalPairs(polynomials, pairs_to_check, f);
                 }
 
-                while(!pairs_to_check.empty()) {
-                    NUtils::CriticalPair<TCoef, TComp> cp = (*pairs_to_check.begin());
-                    pairs_to_check.erase(pairs_to_check.begin());
+                std::vector<typename NUtil::CriticalPairQueue<TCoef, TComp>::TPair> pairs;
+                while(!pairs_to_check.Empty()) {
+                    pairs_to_check.TakeLowest(pairs);
+                    for (const auto& pair : pairs) {
+                        NUtils::CriticalPair<TCoef, TComp> cp(pairs_to_check.GetLeft(pair), pairs_to_check.GetRight(pair));
+                        NUtils::Polynomial<TCoef, TComp> S = cp.GetGlcm() / cp.GetLeftTerm() * cp.GetLeft() - cp.GetGlcm() / cp.GetRightTerm() * cp.GetRight();
 
-                    NUtils::Polynomial<TCoef, TComp> S = cp.GetGlcm() / cp.GetLeftTerm() * cp.GetLeft() - cp.GetGlcm() / cp.GetRightTerm() * cp.GetRight();
-
-                    if (!NUtil::InplaceReduceToZero(S, polynomials)) {
-                        NUtil::UpdateCriticalPairs(polynomials, pairs_to_check, S);
+                        if (!NUtil::InplaceReduceToZero(S, polynomials)) {
+                            NUtil::UpdateCriticalPairs(polynomials, pairs_to_check, S);
+                        }
                     }
                 }
                 NUtil::UpdateBasis(polynomials, F);
@@ -0,0 +1,280 @@
+#pragma once
+#include "../../util/polynomial.h"
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+namespace FF4 {
+    namespace NAlgo {
+        namespace NUtil {
+            // Which pairs F4 takes in a step. Normal takes the pairs of the lowest lcm degree. Sugar takes the pairs of
+            // the lowest sugar degree, the degree their S-polynomial would have if the input were homogenized, so
+            // non homogeneous systems proceed as their homogenization does.
+            enum class ESelectionStrategy {
+                Normal,
+                Sugar,
+            };
+
+            // Critical pairs of a basis which grows by Insert. Basis elements are numbered in the order of insertion,
+            // a pair is the two numbers, a handle of its lcm, the degree of the lcm and its sugar degree. The lcms share
+            // one flat array of exponents with a row per handle, freed rows are reused. Pairs wait in buckets by the
+            // degree the strategy selects by, so taking all pairs of the lowest one is a swap of one bucket. A capped
+            // take moves an offset past the taken pairs, the bucket is cleared once all of them are taken.
+            template <typename TCoef, typename TComp>
+            class CriticalPairQueue {
+                public:
+                    struct TPair {
+                        uint32_t left;
+                        uint32_t right;
+                        uint32_t lcm;
+                        NUtils::Term::Degree degree;
+                        NUtils::Term::Degree sugar;
+                    };
+
+                    explicit CriticalPairQueue(ESelectionStrategy strategy = ESelectionStrategy::Normal)
+                        : strategy_(strategy)
+                    {
+                    }
+
+                    bool Empty() const noexcept {
+                        return size_ == 0;
+                    }
+
+                    size_t Size() const noexcept {
+                        return size_;
+                    }
+
+                    const NUtils::Polynomial<TCoef, TComp>& GetLeft(const TPair& pair) const noexcept {
+                        return *basis_[pair.left];
+                    }
+
+                    const NUtils::Polynomial<TCoef, TComp>& GetRight(const TPair& pair) const noexcept {
+                        return *basis_[pair.right];
+                    }
+
+                    // Adds f of the given sugar degree to the basis and updates the pairs by Gebauer-Moller. The sugar of
+                    // a pair (a, b) is the larger of sugar(a) + deg(lcm / LT(a)) and sugar(b) + deg(lcm / LT(b)).
+                    // The polynomial must outlive the queue.
+                    // B: an old pair (a, b) goes if LT(f) divides lcm(a, b) and lcm(a, f), lcm(f, b) both differ from it.
+                    // M and F: the new pairs are sorted by lcm degree and exponents, so a proper divisor of an lcm comes
+                    // before it and pairs with equal lcm are adjacent. A group of equal lcm goes if an lcm kept before
+                    // divides it, otherwise its lcm is kept and one pair of it stays unless some pair of it has coprime
+                    // leading terms. Elements whose leading terms are multiples of LT(f) get no new pairs after it.
+                    // Divisibility masks rule out most candidates before the exponent tests.
+                    void Insert(const NUtils::Polynomial<TCoef, TComp>& f, NUtils::Term::Degree sugar) {
+                        const NUtils::Term& term = f.GetLeadingTerm();
+                        if (term.size() > variables_) {
+                            Widen(term.size());
+                        }
+                        const uint32_t h = basis_.size();
+                        basis_.push_back(&f);
+                        redundant_.push_back(false);
+                        sugar_.push_back(sugar);
+                        leading_degrees_.push_back(term.TotalDegree());
+                        leading_masks_.push_back(NUtils::DivisibilityMask(term));
+                        leading_.resize(leading_.size() + variables_);
+                        uint16_t* hexp = &leading_[h * variables_];
+                        std::copy(term.GetData().begin(), term.GetData().end(), hexp);
+                        const uint64_t hmask = leading_masks_[h];
+
+                        for (size_t key = 0; key < buckets_.size(); key++) {
+                            auto& bucket = buckets_[key];
+                            auto last = std::remove_if(bucket.begin() + taken_[key], bucket.end(), [&](const TPair& pair) {
+                                const uint16_t* l = Lcm(pair.lcm);
+                                if ((hmask & ~masks_[pair.lcm]) != 0 || !Divides(hexp, l)) {
+                                    return false;
+                                }
+                                if (IsLcm(l, Leading(pair.left), hexp) || IsLcm(l, hexp, Leading(pair.right))) {
+                                    return false;
+                                }
+                                Free(pair.lcm);
+                                size_--;
+                                return true;
+                            });
+                            bucket.erase(last, bucket.end());
+                            if (taken_[key] == bucket.size()) {
+                                bucket.clear();
+                                taken_[key] = 0;
+                            }
+                        }
+
+                        std::vector<uint32_t> others;
+                        for (uint32_t i = 0; i < h; i++) {
+                            if (!redundant_[i]) {
+                                others.push_back(i);
+                            }
+                        }
+                        const size_t n = others.size();
+                        std::vector<uint16_t> lcms(n * variables_);
+                        std::vector<uint64_t> lcm_masks(n);
+                        std::vector<NUtils::Term::Degree> degrees(n);
+                        std::vector<bool> coprime(n);
+                        for (size_t k = 0; k < n; k++) {
+                            const uint16_t* other = Leading(others[k]);
+                            uint16_t* l = &lcms[k * variables_];
+                            bool disjoint = true;
+                            for (size_t v = 0; v < variables_; v++) {
+                                l[v] = std::max(hexp[v], other[v]);
+                                degrees[k] += l[v];
+                                disjoint = disjoint && (hexp[v] == 0 || other[v] == 0);
+                            }
+                            lcm_masks[k] = hmask | leading_masks_[others[k]];
+                            coprime[k] = disjoint;
+                        }
+                        std::vector<size_t> order(n);
+                        std::iota(order.begin(), order.end(), 0);
+                        auto compare = [&](size_t a, size_t b) {
+                            if (degrees[a] != degrees[b]) {
+                                return degrees[a] < degrees[b];
+                            }
+                            return std::lexicographical_compare(&lcms[a * variables_], &lcms[(a + 1) * variables_], &lcms[b * variables_], &lcms[(b + 1) * variables_]);
+                        };
+                        std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+                            return compare(a, b) || (!compare(b, a) && others[a] < others[b]);
+                        });
+
+                        std::vector<size_t> kept;
+                        for (size_t i = 0, j = 0; i < n; i = j) {
+                            const size_t k = order[i];
+                            const uint16_t* l = &lcms[k * variables_];
+                            bool has_coprime = false;
+                            for (j = i; j < n && degrees[order[j]] == degrees[k] && std::equal(l, l + variables_, &lcms[order[j] * variables_]); j++) {
+                                has_coprime = has_coprime || coprime[order[j]];
+                            }
+                            const bool divided = std::any_of(kept.begin(), kept.end(), [&](size_t d) {
+                                return (lcm_masks[d] & ~lcm_masks[k]) == 0 && Divides(&lcms[d * variables_], l);
+                            });
+                            if (divided) {
+                                continue;
+                            }
+                            kept.push_back(k);
+                            if (!has_coprime) {
+                                const uint32_t slot = Allocate();
+                                std::copy(l, l + variables_, Lcm(slot));
+                                masks_[slot] = lcm_masks[k];
+                                const uint32_t other = others[k];
+                                const NUtils::Term::Degree other_sugar = sugar_[other] + degrees[k] - leading_degrees_[other];
+                                const NUtils::Term::Degree new_sugar = sugar + degrees[k] - leading_degrees_[h];
+                                Push({other, h, slot, degrees[k], std::max(other_sugar, new_sugar)});
+                            }
+                        }
+
+                        for (uint32_t i = 0; i < h; i++) {
+                            if (!redundant_[i] && (hmask & ~leading_masks_[i]) == 0 && Divides(hexp, Leading(i))) {
+                                redundant_[i] = true;
+                            }
+                        }
+                    }
+
+                    // Moves the pairs of the lowest degree the strategy selects by to pairs and frees their lcms. If
+                    // max_pairs is positive, at most that many of them are taken, the ones queued first.
+                    void TakeLowest(std::vector<TPair>& pairs, size_t max_pairs = 0) {
+                        pairs.clear();
+                        while (buckets_[lowest_].empty()) {
+                            lowest_++;
+                        }
+                        auto& bucket = buckets_[lowest_];
+                        size_t& taken = taken_[lowest_];
+                        if (taken == 0 && (max_pairs == 0 || bucket.size() <= max_pairs)) {
+                            pairs.swap(bucket);
+                        } else {
+                            const size_t count = max_pairs == 0 ? bucket.size() - taken : std::min(max_pairs, bucket.size() - taken);
+                            pairs.assign(bucket.begin() + taken, bucket.begin() + taken + count);
+                            taken += count;
+                            if (taken == bucket.size()) {
+                                bucket.clear();
+                                taken = 0;
+                            }
+                        }
+                        size_ -= pairs.size();
+                        for (const auto& pair : pairs) {
+                            Free(pair.lcm);
+                        }
+                    }
+
+                private:
+                    const uint16_t* Leading(uint32_t i) const noexcept {
+                        return &leading_[i * variables_];
+                    }
+
+                    uint16_t* Lcm(uint32_t slot) noexcept {
+                        return &lcms_[slot * variables_];
+                    }
+
+                    bool Divides(const uint16_t* a, const uint16_t* b) const noexcept {
+                        for (size_t v = 0; v < variables_; v++) {
+                            if (a[v] > b[v]) {
+                                return false;
+                            }
+                        }
+                        return true;
+                    }
+
+                    bool IsLcm(const uint16_t* l, const uint16_t* a, const uint16_t* b) const noexcept {
+                        for (size_t v = 0; v < variables_; v++) {
+                            if (l[v] != std::max(a[v], b[v])) {
+                                return false;
+                            }
+                        }
+                        return true;
+                    }
+
+                    uint32_t Allocate() {
+                        if (free_.empty()) {
+                            masks_.push_back(0);
+                            lcms_.resize(lcms_.size() + variables_);
+                            return masks_.size() - 1;
+                        }
+                        const uint32_t slot = free_.back();
+                        free_.pop_back();
+                        return slot;
+                    }
+
+                    void Free(uint32_t slot) {
+                        free_.push_back(slot);
+                    }
+
+                    void Push(const TPair& pair) {
+                        const size_t key = strategy_ == ESelectionStrategy::Sugar ? pair.sugar : pair.degree;
+                        if (key >= buckets_.size()) {
+                            buckets_.resize(key + 1);
+                            taken_.resize(key + 1);
+                        }
+                        buckets_[key].push_back(pair);
+                        lowest_ = size_ == 0 ? key : std::min(lowest_, key);
+                        size_++;
+                    }
+
+                    // Lays out the exponent arrays for more variables.
+                    void Widen(size_t variables) {
+                        for (auto* exponents : {&leading_, &lcms_}) {
+                            const size_t rows = variables_ == 0 ? 0 : exponents->size() / variables_;
+                            std::vector<uint16_t> wide(rows * variables);
+                            for (size_t row = 0; row < rows; row++) {
+                                std::copy(&(*exponents)[row * variables_], &(*exponents)[(row + 1) * variables_], &wide[row * variables]);
+                            }
+                            exponents->swap(wide);
+                        }
+                        variables_ = variables;
+                    }
+
+                    std::vector<const NUtils::Polynomial<TCoef, TComp>*> basis_;
+                    ESelectionStrategy strategy_;
+                    std::vector<bool> redundant_;
+                    std::vector<NUtils::Term::Degree> sugar_;
+                    std::vector<NUtils::Term::Degree> leading_degrees_;
+                    std::vector<uint16_t> leading_;
+                    std::vector<uint64_t> leading_masks_;
+                    std::vector<uint16_t> lcms_;
+                    std::vector<uint64_t> masks_;
+                    std::vector<uint32_t> free_;
+                    std::vector<std::vector<TPair>> buckets_;
+                    std::vector<size_t> taken_; // pairs at the front of a bucket which are already taken
+                    size_t lowest_ = 0;
+                    size_t size_ = 0;
+                    size_t variables_ = 0;
+            };
+        }
+    }
+}
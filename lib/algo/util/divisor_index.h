@@ -0,0 +1,119 @@
+#pragma once
+#include "../../util/polynomial.h"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace FF4 {
+    namespace NAlgo {
+        namespace NUtil {
+            // Which divisor of a term becomes its reducer in symbolic preprocessing. Least takes the least leading
+            // term, the first divisor in the order of TPolynomialSet. Sparsest takes the one with the fewest terms,
+            // Newest the one added to the basis last and LowestMultiplier the one with the leading term of the
+            // highest degree. Ties go to the least leading term.
+            enum class EReducerChoice {
+                Least,
+                Sparsest,
+                Newest,
+                LowestMultiplier,
+            };
+
+            // Trie over the exponent vectors of the leading terms of a basis. A node of depth i has its children
+            // sorted by the exponent of the i-th variable, and holds the polynomial whose leading term ends there,
+            // with zero exponents of the variables after i. A lookup of t descends only into the children with
+            // exponents not above the ones of t, so it visits the divisors of t and their prefixes instead of the
+            // whole basis. Polynomials are not owned and have to outlive the index.
+            template <typename TCoef, typename TComp>
+            class DivisorIndex {
+            public:
+                using TPolynomial = NUtils::Polynomial<TCoef, TComp>;
+
+                DivisorIndex()
+                : nodes_(1)
+                {
+                }
+
+                // A polynomial with the leading term of an indexed one is ignored.
+                void Insert(const TPolynomial& f) {
+                    const auto& exponents = f.GetLeadingTerm().GetData();
+                    uint32_t node = 0;
+                    for (uint16_t exponent : exponents) {
+                        auto& children = nodes_[node].children;
+                        auto it = std::lower_bound(children.begin(), children.end(), exponent, [](const TChild& child, uint16_t e) {
+                            return child.first < e;
+                        });
+                        if (it == children.end() || it->first != exponent) {
+                            it = children.insert(it, {exponent, static_cast<uint32_t>(nodes_.size())});
+                            nodes_.emplace_back();
+                        }
+                        node = it->second;
+                    }
+                    if (!nodes_[node].polynomial) {
+                        nodes_[node].polynomial = &f;
+                        nodes_[node].order = size_++;
+                    }
+                }
+
+                // Indexed polynomial with a leading term dividing t which is the best for the given choice, nullptr if
+                // there is none.
+                const TPolynomial* FindDivisor(const NUtils::Term& t, EReducerChoice choice = EReducerChoice::Least) const {
+                    const TNode* best = nullptr;
+                    FindDivisor(0, 0, t.GetData(), choice, best);
+                    return best ? best->polynomial : nullptr;
+                }
+
+                size_t Size() const noexcept {
+                    return size_;
+                }
+
+            private:
+                using TChild = std::pair<uint16_t, uint32_t>; // (exponent, node)
+
+                struct TNode {
+                    std::vector<TChild> children;
+                    const TPolynomial* polynomial = nullptr;
+                    size_t order = 0; // number of polynomials inserted before
+                };
+
+                static bool IsBetter(const TNode& a, const TNode& b, EReducerChoice choice) {
+                    const NUtils::Term& a_term = a.polynomial->GetLeadingTerm();
+                    const NUtils::Term& b_term = b.polynomial->GetLeadingTerm();
+                    switch (choice) {
+                        case EReducerChoice::Least:
+                            break;
+                        case EReducerChoice::Sparsest:
+                            if (a.polynomial->GetMonomials().size() != b.polynomial->GetMonomials().size()) {
+                                return a.polynomial->GetMonomials().size() < b.polynomial->GetMonomials().size();
+                            }
+                            break;
+                        case EReducerChoice::Newest:
+                            return a.order > b.order;
+                        case EReducerChoice::LowestMultiplier:
+                            if (a_term.TotalDegree() != b_term.TotalDegree()) {
+                                return a_term.TotalDegree() > b_term.TotalDegree();
+                            }
+                            break;
+                    }
+                    return TComp()(a_term, b_term);
+                }
+
+                void FindDivisor(uint32_t node, size_t depth, const std::vector<uint16_t>& exponents, EReducerChoice choice, const TNode*& best) const {
+                    const TNode& current = nodes_[node];
+                    if (current.polynomial && (!best || IsBetter(current, *best, choice))) {
+                        best = &current;
+                    }
+                    const uint16_t bound = depth < exponents.size() ? exponents[depth] : 0;
+                    for (const auto& [exponent, child] : current.children) {
+                        if (exponent > bound) {
+                            break;
+                        }
+                        FindDivisor(child, depth + 1, exponents, choice, best);
+                    }
+                }
+
+                std::vector<TNode> nodes_;
+                size_t size_ = 0;
+            };
+        }
+    }
+}
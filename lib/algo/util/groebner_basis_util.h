@@ -1,16 +1,15 @@
 #pragma once
 
 #include "../../util/polynomial.h"
-#include "../../util/critical_pair.h"
+#include "critical_pair_queue.h"
+#include <algorithm>
+#include <queue>
 #include <set>
-#include <unordered_set>
+#include <vector>
 
 namespace FF4 {
     namespace NAlgo {
         namespace NUtil {
-            template <typename TCoef, typename TComp>
-            using TPairsSet = std::set<NUtils::CriticalPair<TCoef, TComp>, TComp>;
-
             template <typename TCoef, typename TComp>
             using TPolynomialSet = std::set<NUtils::Polynomial<TCoef, TComp>, TComp>;
 
@@ -42,112 +41,18 @@ namespace FF4 {
                 return F.IsZero();
             }
 
+            // Adds g to the basis and its pairs to the queue, unless the basis already has its leading term. The sugar
+            // degree of g is at least its total degree, which is the sugar of input polynomials.
             template <typename TCoef, typename TComp>
-            void EraseByLcm(TPairsSet<TCoef, TComp>& pairs_to_check, const NUtils::Polynomial<TCoef, TComp>& f) {
-                for (auto it = pairs_to_check.begin(); it != pairs_to_check.end();) {
-                    if (gcd(f.GetLeadingTerm(), it->GetRightTerm()).IsOne()) {
-                        ++it;
-                        continue;
-                    }
-
-                    bool deleted = false;
-                    const NUtils::Term& left = it->GetGlcm();
-                    for (auto jt = pairs_to_check.begin(); jt != pairs_to_check.end(); ++jt) {
-                        if (it == jt) {
-                            continue;
-                        }
-                        if (left.IsDivisibleBy(jt->GetGlcm())) {
-                            it = pairs_to_check.erase(it);
-                            deleted = true;
-                            break;
-                        }
-                    }
-
-                    if (!deleted) {
-                        ++it;
-                    }
-                }
-            }
-
-            template <typename TCoef, typename TComp>
-            bool VGBL(const NUtils::CriticalPair<TCoef, TComp>& cp, const NUtils::Term term) {
-                if (!term.IsDivisibleBy(gcd(cp.GetLeftTerm(), cp.GetRightTerm()))) {
-                    return false;
-                }
-                std::vector<uint16_t> p1 = cp.GetLeftTerm().GetData();
-                std::vector<uint16_t> p2 = term.GetData();
-                std::vector<uint16_t> p3 = cp.GetRightTerm().GetData();
-
-                if (p2.size() > p1.size() && p2.size() > p3.size()) {
-                    return false;
-                }
-
-                size_t sz = std::min(p2.size(), std::min(p1.size(), p3.size()));
-                for (size_t i = 0; i < sz; i++) {
-                    if (std::min(p1[i], p3[i]) == 0) {
-                        continue;
-                    }
-                    if (std::max(p1[i], p3[i]) >= p2[i]) {
-                        continue;
-                    }
-                    return false;
-                }
-                if (p2.size() > p1.size()) {
-                    for (size_t i = sz; i < std::min(p2.size(), p3.size()); i++) {
-                        if (p3[i] >= p2[i]) {
-                            continue;
-                        }
-                        return false;
-                    }
-                }
-                if (p2.size() > p3.size()) {
-                    for (size_t i = sz; i < std::min(p2.size(), p1.size()); i++) {
-                        if (p1[i] >= p2[i]) {
-                            continue;
-                        }
-                        return false;
-                    }
-                }
-                return true;
-            }
-
-            template <typename TCoef, typename TComp>
-            void InsertByLcm(TPairsSet<TCoef, TComp>& old_crit_pairs, TPairsSet<TCoef, TComp>& new_crit_pairs, const NUtils::Polynomial<TCoef, TComp>& f) {
-                for (const auto& cp : old_crit_pairs) {
-                    if (cp.GetGlcm().IsDivisibleBy(f.GetLeadingTerm())) {
-                        continue;
-                    }
-                    if (VGBL(cp, f.GetLeadingTerm())) {
-                        continue;
-                    }
-                    new_crit_pairs.insert(cp);
-                }
-            }
-
-            template <typename TCoef, typename TComp>
-            void InsertByGcd(TPairsSet<TCoef, TComp>& all_crit, TPairsSet<TCoef, TComp>& new_crit_pairs, const NUtils::Polynomial<TCoef, TComp>& f) {
-                for (const auto& cp : all_crit) {
-                    if (!gcd(f.GetLeadingTerm(), cp.GetRightTerm()).IsOne()) {
-                        new_crit_pairs.insert(cp);
-                    }
-                }
-            }
-
-            template <typename TCoef, typename TComp>
-            void UpdateCriticalPairs(TPolynomialSet<TCoef, TComp>& polynomials, TPairsSet<TCoef, TComp>& old_crit_pairs, NUtils::Polynomial<TCoef, TComp>& g) {
+            void UpdateCriticalPairs(TPolynomialSet<TCoef, TComp>& polynomials, CriticalPairQueue<TCoef, TComp>& pairs, NUtils::Polynomial<TCoef, TComp>& g, NUtils::Term::Degree sugar = 0) {
                 g.Normalize();
-                TPairsSet<TCoef, TComp> all_crit, new_crit_pairs;
-                auto [fit, _] = polynomials.insert(g);
-                for (auto it = polynomials.begin(); it != polynomials.end(); ++it) {
-                    if (it != fit) {
-                        all_crit.insert(NUtils::CriticalPair(*fit, *it));
+                auto [fit, inserted] = polynomials.insert(g);
+                if (inserted) {
+                    for (const auto& m : fit->GetMonomials()) {
+                        sugar = std::max(sugar, m.GetTerm().TotalDegree());
                     }
+                    pairs.Insert(*fit, sugar);
                 }
-
-                EraseByLcm(all_crit, *fit);
-                InsertByGcd(all_crit, new_crit_pairs, *fit);
-                InsertByLcm(old_crit_pairs, new_crit_pairs, *fit);
-                old_crit_pairs = std::move(new_crit_pairs);
             }
 
             template <typename TCoef, typename TComp>
@@ -2,121 +2,667 @@
 #include "../../util/polynomial.h"
 #include "../../util/comp.h"
 #include "../../util/matrix.h"
+#include "../../util/hybrid_row.h"
+#include "../../util/row_operations.h"
+#include "../../util/term_hash_set.h"
+#include "../../util/term_sort.h"
+#include "../../util/thread_pool.h"
+#include <cmath>
+#include <limits>
+#include <random>
 #include <set>
-#include <unordered_map>
-#include <unordered_set>
 #include <cstring>
 
 namespace FF4 {
     namespace NAlgo {
         namespace NUtil {
-            using TTermHashSet = std::unordered_set<NUtils::Term, NUtils::TermHasher>;
+            // How GaussElimination picks the pivot of a column among the rows that have a non zero in it.
+            // Columns are always processed in the monomial order, so the Markowitz cost (r_i - 1)(c_j - 1)
+            // of a candidate depends only on its row count r_i and Sparsest is Markowitz pivoting.
+            enum class EPivotStrategy {
+                First,
+                Sparsest,
+            };
+
+            // Reduced clears the leading column of a pivot in all other rows of D, so the new polynomials are
+            // interreduced. RowEchelon skips the eliminations in the rows which are already pivots: leading terms
+            // of the new polynomials are distinct and their tails are reduced by the pivots of A | B only.
+            enum class EEchelonForm {
+                Reduced,
+                RowEchelon,
+            };
+
+            struct TMatrixReductionStats {
+                size_t matrices = 0;
+                // subtractions of a multiple of one row from another: of pivot rows from the rows of C and from each
+                // other, of rows of D from kept pivot rows and from each other in echelonization and compression
+                size_t row_operations = 0;
+                size_t fill_in = 0; // entries of D turned from zero to non zero during echelonization
+                double failure_probability = 0; // bound on the chance that Monte Carlo compression lost a row, summed over matrices
+                size_t entries = 0; // non zeros of the matrices as built
+                size_t reducers = 0; // rows added by symbolic preprocessing
+                size_t reducer_terms = 0;
+            };
+
+            // How the rows of D are stored. Hybrid rows stay sparse until their share of non zeros goes
+            // above hybrid_density, so the dense D is never allocated for matrices with sparse reduced rows.
+            enum class ERowStorage {
+                Dense,
+                Hybrid,
+            };
+
+            // A connected component of D is echelonized in parallel only with the default pivoting and without statistics.
+            // Hybrid rows are always echelonized row by row, pivoting and fill in statistics do not apply to them.
+            struct TMatrixReductionOptions {
+                size_t threads = 1;
+                EPivotStrategy pivoting = EPivotStrategy::First;
+                TMatrixReductionStats* stats = nullptr;
+                ERowStorage storage = ERowStorage::Dense;
+                double hybrid_density = 0.25;
+                size_t tiled_elimination_bytes = 64 << 20; // larger dense D blocks are echelonized by TiledGaussElimination
+                EEchelonForm echelon = EEchelonForm::Reduced;
+                // Non pivot rows of dense D blocks over prime fields are compressed by CompressByPivots if positive.
+                double failure_probability = 0;
+                uint64_t seed = 1;
+                // Dense D is split into blocks of rows and columns which share no non zeros, they are echelonized
+                // independently. The result is the same as for the whole D.
+                bool split_components = true;
+                // Dense D over a prime field taking more bytes is kept in a memory mapped temporary file and is
+                // echelonized by TiledGaussElimination in column panels of about half the budget, 0 means no limit.
+                // The file is swept once per panel, the columns right of a panel are updated by the threads in tiles.
+                // Mapped D is always pivoted as with First and is not split into components.
+                size_t memory_budget = 0;
+            };
+
+            // Row u * f of an F4 matrix. f is not multiplied out, the terms of the row are the terms of f shifted
+            // by u and are computed only where a column is looked up.
+            template <typename TCoef, typename TComp>
+            struct TMultipliedRow {
+                const NUtils::Polynomial<TCoef, TComp>* polynomial;
+                NUtils::Term multiplier;
+                NUtils::Term leading;
+
+                // term = u * m, the storage of term is reused.
+                void GetTerm(const NUtils::Monomial<TCoef>& m, NUtils::Term& term) const {
+                    term = m.GetTerm();
+                    term *= multiplier;
+                }
+            };
+
+            template <typename TCoef, typename TComp>
+            using TMultipliedRows = std::vector<TMultipliedRow<TCoef, TComp>>;
 
             template<typename TCoef, typename TComp>
-            using TSymbolicPreprocessingResult = std::pair<NUtils::TPolynomials<TCoef, TComp>, std::vector<NUtils::Term>>;
+            using TSymbolicPreprocessingResult = std::pair<TMultipliedRows<TCoef, TComp>, std::vector<NUtils::Term>>;
+
+            // Faugere-Lachartre decomposition of the F4 matrix:
+            //     A | B    pivot rows, A is upper unitriangular, the diagonal is implicit
+            //     -----
+            //     C | D    non pivot rows
+            // Columns of A and C are the pivot columns, columns of B and D are the rest.
+            // With hybrid storage D is left empty and its rows are kept in H instead.
+            template <typename TCoef>
+            struct TBlockMatrix {
+                TBlockMatrix(size_t pivots, size_t rows, size_t columns, bool hybrid = false, size_t memory_budget = 0)
+                : A(pivots, pivots)
+                , B(pivots, columns - pivots)
+                , C(rows - pivots, pivots)
+                , D(hybrid ? 0 : rows - pivots, columns - pivots, memory_budget)
+                , H(hybrid ? rows - pivots : 0)
+                {
+                }
+
+                NUtils::SparseMatrix<TCoef> A;
+                NUtils::SparseMatrix<TCoef> B;
+                NUtils::SparseMatrix<TCoef> C;
+                NUtils::Matrix<TCoef> D;
+                std::vector<NUtils::HybridRow<TCoef>> H;
+            };
 
             template <typename TCoef, typename TComp>
-            size_t FillMatrix(NUtils::TPolynomials<TCoef, TComp>& F, NUtils::Matrix<TCoef>& matrix, std::vector<NUtils::Term>& vTerms, const std::vector<NUtils::Term>& diffSet, std::vector<std::vector<size_t> >& nnext) {
+            TBlockMatrix<TCoef> FillMatrix(TMultipliedRows<TCoef, TComp>& F, std::vector<NUtils::Term>& vTerms, const std::vector<NUtils::Term>& diffSet, bool hybrid = false, size_t memory_budget = 0) {
                 size_t cnt = 0;
-                size_t swp = 0;
                 std::vector<bool> not_pivot(F.size());
-                TTermHashSet leadingTerms;
-                std::unordered_map<NUtils::Term, size_t, NUtils::TermHasher> Mp;
+                NUtils::TermHashMap<size_t> Mp;
+                Mp.Reserve(diffSet.size());
                 for (size_t i = 0; i < F.size(); i++) {
-                    auto [_, inserted] = leadingTerms.insert(F[i].GetLeadingTerm());
+                    auto [_, inserted] = Mp.Insert(F[i].leading, cnt);
                     if (!inserted) {
                         not_pivot[i] = true;
-                        swp++;
                         continue;
                     }
-                    Mp[F[i].GetLeadingTerm()] = cnt;
-                    vTerms[cnt] = F[i].GetLeadingTerm();
+                    vTerms[cnt] = F[i].leading;
                     cnt++;
                 }
+                const size_t pivots = cnt;
 
                 cnt = diffSet.size() - 1;
                 for (auto& term : diffSet) {
-                    if (Mp.find(term) == Mp.end()) {
-                        Mp[term] = cnt;
+                    if (Mp.Insert(term, cnt).second) {
                         vTerms[cnt] = term;
                         cnt--;
                     }
                 }
 
-                nnext.reserve(F.size() - swp);
+                TBlockMatrix<TCoef> blocks(pivots, F.size(), diffSet.size(), hybrid, memory_budget);
+                NUtils::Term term;
                 for (size_t i = 0, j = 0; i < F.size(); i++) {
                     if (not_pivot[i]) {
                         j++;
                         continue;
                     }
-                    std::vector<size_t> next;
-                    next.reserve(F[i].GetMonomials().size());
-                    for (const auto& m : F[i].GetMonomials()) {
-                        const auto& term = m.GetTerm();
-                        size_t column = Mp[term];
-                        matrix(i - j, column) = m.GetCoef();
-                        next.push_back(column);
+                    const auto& monomials = F[i].polynomial->GetMonomials();
+                    const size_t row = i - j;
+                    const TCoef inv = TCoef(1) / monomials[0].GetCoef();
+                    for (size_t k = 1; k < monomials.size(); k++) {
+                        F[i].GetTerm(monomials[k], term);
+                        size_t column = *Mp.Find(term);
+                        TCoef coef = monomials[k].GetCoef();
+                        if (inv != 1) {
+                            coef *= inv;
+                        }
+                        if (column < pivots) {
+                            blocks.A.PushBack(row, column, coef);
+                        } else {
+                            blocks.B.PushBack(row, column - pivots, coef);
+                        }
                     }
-                    nnext.push_back(std::move(next));
                 }
 
-                for (size_t i = 0, j = 0; i < F.size(); i++) {
+                // Non pivot rows are stored in reverse order, the first one goes to the bottom of C | D.
+                for (size_t i = F.size(), row = 0; i-- > 0;) {
                     if (!not_pivot[i]) {
                         continue;
                     }
-                    for (const auto& m : F[i].GetMonomials()) {
-                        const auto& term = m.GetTerm();
-                        matrix(F.size() - 1 - j, Mp[term]) = m.GetCoef();
+                    for (const auto& m : F[i].polynomial->GetMonomials()) {
+                        F[i].GetTerm(m, term);
+                        size_t column = *Mp.Find(term);
+                        if (column < pivots) {
+                            blocks.C.PushBack(row, column, m.GetCoef());
+                        } else if (hybrid) {
+                            blocks.H[row].PushBack(column - pivots, m.GetCoef());
+                        } else {
+                            blocks.D(row, column - pivots) = m.GetCoef();
+                        }
                     }
-                    j++;
+                    row++;
                 }
 
-                return F.size() - swp;
+                return blocks;
             }
 
             template <typename TCoef>
-            void GaussElimination(NUtils::Matrix<TCoef>& matrix, size_t pivots) {
+            size_t CountNonZeros(const TCoef* row, size_t n) {
+                size_t cnt = 0;
+                for (size_t i = 0; i < n; i++) {
+                    if (row[i] != 0) {
+                        cnt++;
+                    }
+                }
+                return cnt;
+            }
+
+            // Number of zeros of row which become non zero after subtracting a multiple of pivot.
+            template <typename TCoef>
+            size_t CountFillIn(const TCoef* row, const TCoef* pivot, size_t n) {
+                size_t cnt = 0;
+                for (size_t i = 0; i < n; i++) {
+                    if (row[i] == 0 && pivot[i] != 0) {
+                        cnt++;
+                    }
+                }
+                return cnt;
+            }
+
+            template <typename TCoef>
+            void GaussElimination(NUtils::Matrix<TCoef>& matrix, size_t pivots, EPivotStrategy strategy = EPivotStrategy::First, TMatrixReductionStats* stats = nullptr, EEchelonForm form = EEchelonForm::Reduced) {
+                const bool count = strategy == EPivotStrategy::Sparsest || stats;
+                std::vector<size_t> weight;
+                if (count) {
+                    weight.resize(matrix.N_);
+                    for (size_t i = pivots; i < matrix.N_; i++) {
+                        weight[i] = CountNonZeros(matrix.Row(i), matrix.M_);
+                    }
+                }
+
                 std::vector<bool> used(matrix.N_);
                 for (size_t j = pivots; j < matrix.M_; j++) {
-                    for (size_t i = pivots; i < matrix.N_; i++) {
-                        if (used[i] || matrix(i, j) == 0) {
+                    size_t i = matrix.N_;
+                    for (size_t k = pivots; k < matrix.N_; k++) {
+                        if (used[k] || matrix(k, j) == 0) {
+                            continue;
+                        }
+                        if (i == matrix.N_ || weight[k] < weight[i]) {
+                            i = k;
+                        }
+                        if (strategy == EPivotStrategy::First) {
+                            break;
+                        }
+                    }
+                    if (i == matrix.N_) {
+                        continue;
+                    }
+
+                    used[i] = true;
+                    TCoef factor = matrix(i, j);
+                    if (factor != 1) {
+                        TCoef inverse = TCoef(1) / factor;
+                        for (size_t k = j; k < matrix.M_; k++) {
+                            matrix(i, k) *= inverse;
+                        }
+                    }
+
+                    for (size_t k = pivots; k < matrix.N_; k++) {
+                        if (k == i || (form == EEchelonForm::RowEchelon && used[k])) {
                             continue;
                         }
+                        TCoef factor = matrix(k, j);
+                        if (factor == 0) {
+                            continue;
+                        }
+                        TCoef* row = matrix.Row(k) + j;
+                        const TCoef* pivot = matrix.Row(i) + j;
+                        const size_t n = matrix.M_ - j;
+                        if (!count) {
+                            NUtils::SubtractMultiple(row, pivot, factor, n);
+                            continue;
+                        }
+                        const size_t fill_in = CountFillIn(row, pivot, n);
+                        const size_t before = CountNonZeros(row, n);
+                        NUtils::SubtractMultiple(row, pivot, factor, n);
+                        weight[k] = weight[k] - before + CountNonZeros(row, n);
+                        if (stats) {
+                            stats->row_operations++;
+                            stats->fill_in += fill_in;
+                        }
+                    }
+                }
+            }
+
+            // Blocked GaussElimination with the default pivoting. Pivots of a panel of columns are found by
+            // eliminating within the panel only, the row operations are recorded and then replayed on the rest of
+            // the row in column tiles which fit into the cache together with the touched rows. On the pivot rows
+            // of the panel this is the TRSM step and on the other rows the AXPY step of blocked LU. Every column
+            // sees the same operations in the same order as in GaussElimination, so the result and the stats are
+            // the same. Tiles are independent, they are replayed in parallel if a pool is given.
+            // It pays off only once the matrix does not fit into the last level cache, short tiles lose
+            // more on the per call overhead of the row kernels than they save.
+            template <typename TCoef>
+            void TiledGaussElimination(NUtils::Matrix<TCoef>& matrix, EEchelonForm form = EEchelonForm::Reduced, size_t panel = 64, size_t tile = 0, TMatrixReductionStats* stats = nullptr, NUtils::ThreadPool* pool = nullptr) {
+                struct TRowOperation {
+                    size_t row;
+                    size_t pivot; // the row is scaled by factor if pivot == row
+                    TCoef factor;
+                };
+                if (tile == 0) {
+                    constexpr size_t cache = 8 << 20;
+                    tile = std::max<size_t>(256, cache / (sizeof(TCoef) * std::max<size_t>(1, matrix.N_)));
+                }
+
+                std::vector<size_t> fill_in(pool ? pool->Size() : 1);
+                std::vector<bool> used(matrix.N_);
+                std::vector<TRowOperation> operations;
+                for (size_t start = 0; start < matrix.M_; start += panel) {
+                    const size_t end = std::min(matrix.M_, start + panel);
+                    operations.clear();
+                    for (size_t j = start; j < end; j++) {
+                        size_t i = 0;
+                        while (i < matrix.N_ && (used[i] || matrix(i, j) == 0)) {
+                            i++;
+                        }
+                        if (i == matrix.N_) {
+                            continue;
+                        }
+
                         used[i] = true;
                         TCoef factor = matrix(i, j);
                         if (factor != 1) {
-                            for (size_t k = j; k < matrix.M_; k++) {
-                                matrix(i, k) /= factor;
+                            TCoef inverse = TCoef(1) / factor;
+                            for (size_t k = j; k < end; k++) {
+                                matrix(i, k) *= inverse;
                             }
+                            operations.push_back({i, i, inverse});
                         }
-                        
-                        for (size_t k = pivots; k < matrix.N_; k++) {
-                            if (k == i) {
+                        for (size_t k = 0; k < matrix.N_; k++) {
+                            if (k == i || (form == EEchelonForm::RowEchelon && used[k])) {
                                 continue;
                             }
                             TCoef factor = matrix(k, j);
-                            if (factor != 0) {
-                                for (size_t q = j; q < matrix.M_; q++) {
-                                    matrix(k, q) -= matrix(i, q) * factor;
+                            if (factor == 0) {
+                                continue;
+                            }
+                            if (stats) {
+                                stats->row_operations++;
+                                fill_in[0] += CountFillIn(matrix.Row(k) + j, matrix.Row(i) + j, end - j);
+                            }
+                            NUtils::SubtractMultiple(matrix.Row(k) + j, matrix.Row(i) + j, factor, end - j);
+                            operations.push_back({k, i, factor});
+                        }
+                    }
+
+                    auto replay = [&](size_t worker, size_t task) {
+                        const size_t from = end + task * tile;
+                        const size_t n = std::min(matrix.M_, from + tile) - from;
+                        for (const auto& operation : operations) {
+                            TCoef* row = matrix.Row(operation.row) + from;
+                            if (operation.pivot == operation.row) {
+                                for (size_t k = 0; k < n; k++) {
+                                    row[k] *= operation.factor;
                                 }
+                                continue;
+                            }
+                            const TCoef* pivot = matrix.Row(operation.pivot) + from;
+                            if (stats) {
+                                fill_in[worker] += CountFillIn(row, pivot, n);
+                            }
+                            NUtils::SubtractMultiple(row, pivot, operation.factor, n);
+                        }
+                    };
+                    const size_t tiles = (matrix.M_ - end + tile - 1) / tile;
+                    if (pool && pool->Size() > 1 && tiles > 1) {
+                        pool->ParallelFor(tiles, replay);
+                    } else {
+                        for (size_t task = 0; task < tiles; task++) {
+                            replay(0, task);
+                        }
+                    }
+                }
+                if (stats) {
+                    for (size_t count : fill_in) {
+                        stats->fill_in += count;
+                    }
+                }
+            }
+
+            // Same reduced row echelon form as GaussElimination, computed row by row: row i is reduced by the
+            // pivots of the rows above it and becomes a new pivot unless it vanishes. Rows go in batches, a batch
+            // is reduced by the known pivots in parallel, new pivots of the batch are found sequentially and
+            // then eliminated from the older pivot rows in parallel. In row echelon form pivot rows are left as found,
+            // a pivot still has zeros in the leading columns of the pivots before it, so rows are reduced by
+            // the pivots in the order they were found.
+            template <typename TCoef>
+            void ParallelGaussElimination(NUtils::Matrix<TCoef>& matrix, NUtils::ThreadPool& pool, EEchelonForm form = EEchelonForm::Reduced) {
+                std::vector<std::pair<size_t, size_t>> pivots; // (leading column, row)
+                auto reduce = [&](size_t i, size_t from, size_t to) {
+                    for (size_t p = from; p < to; p++) {
+                        const auto [j, row] = pivots[p];
+                        TCoef factor = matrix(i, j);
+                        if (factor != 0) {
+                            NUtils::SubtractMultiple(matrix.Row(i) + j, matrix.Row(row) + j, factor, matrix.M_ - j);
+                        }
+                    }
+                };
+
+                const size_t batch = pool.Size() * 4;
+                for (size_t start = 0; start < matrix.N_; start += batch) {
+                    const size_t end = std::min(matrix.N_, start + batch);
+                    const size_t old = pivots.size();
+                    pool.ParallelFor(end - start, [&](size_t, size_t task) {
+                        reduce(start + task, 0, old);
+                    });
+
+                    for (size_t i = start; i < end; i++) {
+                        reduce(i, old, pivots.size());
+                        size_t j = 0;
+                        while (j < matrix.M_ && matrix(i, j) == 0) {
+                            j++;
+                        }
+                        if (j == matrix.M_) {
+                            continue;
+                        }
+                        TCoef factor = matrix(i, j);
+                        if (factor != 1) {
+                            TCoef inverse = TCoef(1) / factor;
+                            for (size_t k = j; k < matrix.M_; k++) {
+                                matrix(i, k) *= inverse;
+                            }
+                        }
+                        for (size_t p = old; p < pivots.size() && form == EEchelonForm::Reduced; p++) {
+                            const size_t row = pivots[p].second;
+                            TCoef factor = matrix(row, j);
+                            if (factor != 0) {
+                                NUtils::SubtractMultiple(matrix.Row(row) + j, matrix.Row(i) + j, factor, matrix.M_ - j);
+                            }
+                        }
+                        pivots.emplace_back(j, i);
+                    }
+
+                    if (form == EEchelonForm::RowEchelon) {
+                        continue;
+                    }
+                    pool.ParallelFor(old, [&](size_t, size_t p) {
+                        reduce(pivots[p].second, old, pivots.size());
+                    });
+                }
+            }
+
+            // ParallelGaussElimination on hybrid rows of the given width. In reduced form a pivot row has zeros in
+            // the leading columns of the other pivots, so the factors of all pivots are read off a sparse row
+            // before reducing it.
+            template <typename TCoef>
+            void HybridGaussElimination(std::vector<NUtils::HybridRow<TCoef>>& rows, size_t width, double density, NUtils::ThreadPool& pool, EEchelonForm form = EEchelonForm::Reduced) {
+                constexpr size_t none = static_cast<size_t>(-1);
+                std::vector<std::pair<size_t, size_t>> pivots; // (leading column, row)
+                std::vector<size_t> pivot_of_column(width, none);
+                auto reduce = [&](size_t i, size_t from, size_t to) {
+                    if (rows[i].IsDense() || form == EEchelonForm::RowEchelon) {
+                        for (size_t p = from; p < to; p++) {
+                            const auto [j, row] = pivots[p];
+                            TCoef factor = rows[i].Get(j);
+                            if (factor != 0) {
+                                rows[i].SubtractMultiple(rows[row], factor, j, width, density);
                             }
                         }
-                        break;
+                        return;
+                    }
+                    std::vector<std::pair<size_t, TCoef>> factors;
+                    rows[i].ForEachNonZero([&](size_t j, const TCoef& value) {
+                        const size_t p = pivot_of_column[j];
+                        if (p != none && p >= from && p < to) {
+                            factors.emplace_back(p, value);
+                        }
+                    });
+                    for (const auto& [p, factor] : factors) {
+                        rows[i].SubtractMultiple(rows[pivots[p].second], factor, pivots[p].first, width, density);
+                    }
+                };
+
+                const size_t batch = pool.Size() * 4;
+                for (size_t start = 0; start < rows.size(); start += batch) {
+                    const size_t end = std::min(rows.size(), start + batch);
+                    const size_t old = pivots.size();
+                    pool.ParallelFor(end - start, [&](size_t, size_t task) {
+                        reduce(start + task, 0, old);
+                    });
+
+                    for (size_t i = start; i < end; i++) {
+                        reduce(i, old, pivots.size());
+                        const size_t j = rows[i].Leading(width);
+                        if (j == width) {
+                            continue;
+                        }
+                        TCoef factor = rows[i].Get(j);
+                        if (factor != 1) {
+                            rows[i].Scale(TCoef(1) / factor);
+                        }
+                        pivots.emplace_back(j, i);
+                        pivot_of_column[j] = pivots.size() - 1;
+                        for (size_t p = old; p + 1 < pivots.size() && form == EEchelonForm::Reduced; p++) {
+                            reduce(pivots[p].second, pivots.size() - 1, pivots.size());
+                        }
+                    }
+
+                    if (form == EEchelonForm::RowEchelon) {
+                        continue;
+                    }
+                    pool.ParallelFor(old, [&](size_t, size_t p) {
+                        reduce(pivots[p].second, old, pivots.size());
+                    });
+                }
+            }
+
+            // Echelonizes a dense D with the routine picked by the options, stats are collected into the given ones.
+            template <typename TCoef>
+            void EchelonizeDense(NUtils::Matrix<TCoef>& matrix, NUtils::ThreadPool& pool, const TMatrixReductionOptions& options, TMatrixReductionStats* stats) {
+                if (pool.Size() > 1 && options.pivoting == EPivotStrategy::First && !stats) {
+                    ParallelGaussElimination(matrix, pool, options.echelon);
+                } else if (options.pivoting == EPivotStrategy::First && matrix.N_ * matrix.M_ * sizeof(TCoef) > options.tiled_elimination_bytes) {
+                    TiledGaussElimination(matrix, options.echelon, 64, 0, stats);
+                } else {
+                    GaussElimination(matrix, 0, options.pivoting, stats, options.echelon);
+                }
+            }
+
+            // Connected components of the matrix: two columns are connected if a row has non zeros in both.
+            // component[i] is the component of row i, none for a zero row, component[N_ + j] the one of column j.
+            // Returns the number of components.
+            template <typename TCoef>
+            size_t FindComponents(const NUtils::Matrix<TCoef>& matrix, std::vector<size_t>& component) {
+                constexpr size_t none = static_cast<size_t>(-1);
+                std::vector<size_t> parent(matrix.M_, none);
+                auto find = [&parent](size_t j) {
+                    while (parent[j] != j) {
+                        parent[j] = parent[parent[j]];
+                        j = parent[j];
+                    }
+                    return j;
+                };
+                std::vector<size_t> first(matrix.N_, none);
+                for (size_t i = 0; i < matrix.N_; i++) {
+                    const TCoef* row = matrix.Row(i);
+                    for (size_t j = 0; j < matrix.M_; j++) {
+                        if (row[j] == 0) {
+                            continue;
+                        }
+                        if (parent[j] == none) {
+                            parent[j] = j;
+                        }
+                        if (first[i] == none) {
+                            first[i] = j;
+                            continue;
+                        }
+                        const size_t a = find(first[i]);
+                        const size_t b = find(j);
+                        if (a != b) {
+                            parent[std::max(a, b)] = std::min(a, b);
+                        }
+                    }
+                }
+
+                component.assign(matrix.N_ + matrix.M_, none);
+                size_t components = 0;
+                for (size_t j = 0; j < matrix.M_; j++) {
+                    if (parent[j] == none) {
+                        continue;
+                    }
+                    const size_t root = find(j);
+                    if (root == j) {
+                        component[matrix.N_ + j] = components++;
+                    } else {
+                        component[matrix.N_ + j] = component[matrix.N_ + root];
+                    }
+                }
+                for (size_t i = 0; i < matrix.N_; i++) {
+                    if (first[i] != none) {
+                        component[i] = component[matrix.N_ + first[i]];
+                    }
+                }
+                return components;
+            }
+
+            // EchelonizeDense applied to every connected component of D on its own small matrix. Rows and columns of
+            // a component keep their order, so the pivots and the row operations are the ones on the whole D.
+            // Components taking more than a share of a worker are echelonized one by one with the whole pool,
+            // the rest in parallel, one component per task.
+            template <typename TCoef>
+            void ComponentGaussElimination(NUtils::Matrix<TCoef>& matrix, NUtils::ThreadPool& pool, const TMatrixReductionOptions& options) {
+                std::vector<size_t> component;
+                const size_t components = FindComponents(matrix, component);
+                if (components <= 1) {
+                    EchelonizeDense(matrix, pool, options, options.stats);
+                    return;
+                }
+                std::vector<std::vector<size_t>> rows(components);
+                std::vector<std::vector<size_t>> columns(components);
+                for (size_t i = 0; i < matrix.N_; i++) {
+                    if (component[i] < components) {
+                        rows[component[i]].push_back(i);
+                    }
+                }
+                for (size_t j = 0; j < matrix.M_; j++) {
+                    if (component[matrix.N_ + j] < components) {
+                        columns[component[matrix.N_ + j]].push_back(j);
+                    }
+                }
+
+                std::vector<TMatrixReductionStats> stats(components);
+                auto eliminate = [&](size_t c, NUtils::ThreadPool& workers) {
+                    NUtils::Matrix<TCoef> part(rows[c].size(), columns[c].size());
+                    for (size_t i = 0; i < part.N_; i++) {
+                        for (size_t j = 0; j < part.M_; j++) {
+                            part(i, j) = matrix(rows[c][i], columns[c][j]);
+                        }
+                    }
+                    EchelonizeDense(part, workers, options, options.stats ? &stats[c] : nullptr);
+                    for (size_t i = 0; i < part.N_; i++) {
+                        for (size_t j = 0; j < part.M_; j++) {
+                            matrix(rows[c][i], columns[c][j]) = part(i, j);
+                        }
+                    }
+                };
+
+                size_t total = 0;
+                for (size_t c = 0; c < components; c++) {
+                    total += rows[c].size() * columns[c].size();
+                }
+                std::vector<size_t> small;
+                for (size_t c = 0; c < components; c++) {
+                    if (pool.Size() > 1 && rows[c].size() * columns[c].size() * pool.Size() > total) {
+                        eliminate(c, pool);
+                    } else {
+                        small.push_back(c);
+                    }
+                }
+                NUtils::ThreadPool serial(1);
+                pool.ParallelFor(small.size(), [&](size_t, size_t task) {
+                    eliminate(small[task], serial);
+                });
+
+                if (options.stats) {
+                    for (const auto& part : stats) {
+                        options.stats->row_operations += part.row_operations;
+                        options.stats->fill_in += part.fill_in;
+                    }
+                }
+            }
+
+            template <typename TCoef, typename TComp>
+            NUtils::TPolynomials<TCoef, TComp> GetReducedPolynomials(const std::vector<NUtils::HybridRow<TCoef>>& rows, const std::vector<NUtils::Term>& vTerms, size_t pivots) {
+                NUtils::TPolynomials<TCoef, TComp> reduced;
+                reduced.reserve(rows.size());
+                for (const auto& row : rows) {
+                    std::vector<NUtils::Monomial<TCoef>> mons;
+                    row.ForEachNonZero([&](size_t j, const TCoef& value) {
+                        mons.emplace_back(vTerms[pivots + j], value);
+                    });
+                    if (!mons.empty()) {
+                        reduced.emplace_back(std::move(mons));
                     }
                 }
+                return reduced;
             }
 
             template <typename TCoef, typename TComp>
             NUtils::TPolynomials<TCoef, TComp> GetReducedPolynomials(const NUtils::Matrix<TCoef>& matrix, const std::vector<NUtils::Term>& vTerms, size_t pivots) {
                 NUtils::TPolynomials<TCoef, TComp> reduced;
-                reduced.reserve(matrix.N_ - pivots);
-                for (size_t i = pivots; i < matrix.N_; i++) {
+                reduced.reserve(matrix.N_);
+                for (size_t i = 0; i < matrix.N_; i++) {
                     std::vector<NUtils::Monomial<TCoef>> mons;
-                    for (int j = 0; j < matrix.M_; j++) {
+                    for (size_t j = 0; j < matrix.M_; j++) {
                         if (matrix(i, j) == 0) {
                             continue;
                         }
-                        mons.emplace_back(vTerms[j], matrix(i, j));
+                        mons.emplace_back(vTerms[pivots + j], matrix(i, j));
                     }
                     if (!mons.empty()) {
                         reduced.emplace_back(std::move(mons));
@@ -125,19 +671,326 @@ namespace FF4 {
                 return reduced;
             }
 
+            // Pivot rows of A | B brought to I | A^{-1} * B. index[j] is the row of matrix holding the reduced pivot
+            // row j as a dense row of the columns of B, none if the pivot row j is not reduced.
+            template <typename TCoef>
+            struct TReducedPivots {
+                static constexpr size_t none = std::numeric_limits<size_t>::max();
+
+                std::vector<size_t> index;
+                NUtils::Matrix<TCoef> matrix = NUtils::Matrix<TCoef>(0, 0);
+            };
+
+            // Sparse TRSM of the i-th row of C by A, applied to the dense row d on the fly: d -= (C_i * A^{-1}) * B.
+            // acc is a dense accumulator of size A.N_, it is left zeroed. Returns the number of pivot rows subtracted.
+            template <typename TCoef>
+            size_t ReduceRowByPivots(TBlockMatrix<TCoef>& blocks, size_t i, NUtils::TAlignedVector<TCoef>& acc, TCoef* d, const TReducedPivots<TCoef>* reduced = nullptr) {
+                const auto& row_columns = blocks.C.GetColumns(i);
+                if (row_columns.empty()) {
+                    return 0;
+                }
+                const auto& row_values = blocks.C.GetValues(i);
+                for (size_t k = 0; k < row_columns.size(); k++) {
+                    acc[row_columns[k]] = row_values[k];
+                }
+                return ReduceAccumulatorByPivots(blocks, acc, row_columns[0], d, reduced);
+            }
+
+            // Same for a row of C already scattered into acc, which is zero before column from. A reduced pivot row
+            // clears its column of acc alone, so the cascade stops there.
             template <typename TCoef>
-            void NOTRSM(NUtils::Matrix<TCoef>& matrix, size_t pivots, const std::vector<std::vector<size_t> >& nnext) {
+            size_t ReduceAccumulatorByPivots(const TBlockMatrix<TCoef>& blocks, NUtils::TAlignedVector<TCoef>& acc, size_t from, TCoef* d, const TReducedPivots<TCoef>* reduced = nullptr) {
+                size_t operations = 0;
+                for (size_t j = from; j < blocks.A.N_; j++) {
+                    if (acc[j] == 0) {
+                        continue;
+                    }
+                    TCoef factor = acc[j];
+                    acc[j] = 0;
+                    operations++;
+
+                    if (reduced && reduced->index[j] != TReducedPivots<TCoef>::none) {
+                        NUtils::SubtractMultiple(d, reduced->matrix.Row(reduced->index[j]), factor, blocks.B.M_);
+                        continue;
+                    }
+                    const auto& a_columns = blocks.A.GetColumns(j);
+                    NUtils::SubtractMultipleSparse(acc.data(), a_columns.data(), blocks.A.GetValues(j).data(), factor, a_columns.size());
+
+                    const auto& b_columns = blocks.B.GetColumns(j);
+                    NUtils::SubtractMultipleSparse(d, b_columns.data(), blocks.B.GetValues(j).data(), factor, b_columns.size());
+                }
+                return operations;
+            }
+
+            // D <- D - C * A^{-1} * B. Rows of C | D are independent, they are split into chunks between
+            // the workers of the pool, every worker has its own accumulator. Hybrid rows are scattered into
+            // a dense row of the worker, reduced there and stored back as sparse or dense by their density.
+            // The subtracted pivot rows are counted in stats.
+            template <typename TCoef>
+            void ReduceByPivots(TBlockMatrix<TCoef>& blocks, NUtils::ThreadPool& pool, double density = 0, TMatrixReductionStats* stats = nullptr, const TReducedPivots<TCoef>* reduced = nullptr) {
+                const size_t rows = blocks.C.N_;
+                const size_t width = blocks.B.M_;
+                const bool hybrid = !blocks.H.empty();
+                const size_t chunk = std::max<size_t>(1, rows / (pool.Size() * 16));
+                std::vector<NUtils::TAlignedVector<TCoef>> accs(pool.Size());
+                std::vector<NUtils::TAlignedVector<TCoef>> dense(pool.Size());
+                std::vector<size_t> operations(pool.Size());
+                pool.ParallelFor((rows + chunk - 1) / chunk, [&](size_t worker, size_t task) {
+                    NUtils::TAlignedVector<TCoef>& acc = accs[worker];
+                    if (acc.empty()) {
+                        acc.resize(blocks.A.N_);
+                    }
+                    if (hybrid && dense[worker].empty()) {
+                        dense[worker].resize(width);
+                    }
+                    for (size_t i = task * chunk; i < std::min(rows, (task + 1) * chunk); i++) {
+                        if (!hybrid) {
+                            operations[worker] += ReduceRowByPivots(blocks, i, acc, blocks.D.Row(i), reduced);
+                            continue;
+                        }
+                        TCoef* d = dense[worker].data();
+                        blocks.H[i].ForEachNonZero([&](size_t j, const TCoef& value) {
+                            d[j] = value;
+                        });
+                        operations[worker] += ReduceRowByPivots(blocks, i, acc, d, reduced);
+                        blocks.H[i].Assign(d, width, density);
+                    }
+                });
+                if (stats) {
+                    for (size_t count : operations) {
+                        stats->row_operations += count;
+                    }
+                }
+            }
+
+            // Reduces the pivot rows which the cascades of ReduceByPivots may meet at least twice, counted over the
+            // non zeros of C and of the pivot rows met. A row met once costs as much when it is reduced on the way.
+            // The reduced rows stop the cascades of the rows of C and of each other, those at the same depth of
+            // this dependency are reduced in parallel.
+            template <typename TCoef>
+            TReducedPivots<TCoef> ReducePivots(const TBlockMatrix<TCoef>& blocks, NUtils::ThreadPool& pool, TMatrixReductionStats* stats = nullptr, size_t memory_budget = 0) {
+                const size_t pivots = blocks.A.N_;
+                const size_t width = blocks.B.M_;
+                std::vector<size_t> met(pivots);
+                for (size_t i = 0; i < blocks.C.N_; i++) {
+                    for (size_t j : blocks.C.GetColumns(i)) {
+                        met[j]++;
+                    }
+                }
+                for (size_t i = 0; i < pivots; i++) {
+                    if (met[i] != 0) {
+                        for (size_t j : blocks.A.GetColumns(i)) {
+                            met[j]++;
+                        }
+                    }
+                }
+
+                TReducedPivots<TCoef> reduced;
+                reduced.index.assign(pivots, TReducedPivots<TCoef>::none);
+                size_t count = 0;
                 for (size_t i = 0; i < pivots; i++) {
-                    const auto& next = nnext[i];
-                    for (size_t j = pivots; j < matrix.N_; j++) {
-                        if (matrix(j, i) != 0) {
-                            TCoef factor = matrix(j, i);
-                            for (size_t k = 0; k < next.size(); k++) {
-                                matrix(j, next[k]) -= factor * matrix(i, next[k]);
+                    if (met[i] > 1) {
+                        reduced.index[i] = count++;
+                    }
+                }
+                reduced.matrix = NUtils::Matrix<TCoef>(count, width, memory_budget);
+
+                // A row not reduced passes the depth of the reduced rows its cascade meets on.
+                std::vector<size_t> depth(pivots);
+                std::vector<std::vector<size_t>> levels;
+                for (size_t i = pivots; i-- > 0;) {
+                    for (size_t j : blocks.A.GetColumns(i)) {
+                        depth[i] = std::max(depth[i], depth[j] + (reduced.index[j] != TReducedPivots<TCoef>::none));
+                    }
+                    if (reduced.index[i] != TReducedPivots<TCoef>::none) {
+                        if (levels.size() <= depth[i]) {
+                            levels.resize(depth[i] + 1);
+                        }
+                        levels[depth[i]].push_back(i);
+                    }
+                }
+
+                std::vector<NUtils::TAlignedVector<TCoef>> accs(pool.Size());
+                std::vector<size_t> operations(pool.Size());
+                for (const auto& level : levels) {
+                    const size_t chunk = std::max<size_t>(1, level.size() / (pool.Size() * 4));
+                    pool.ParallelFor((level.size() + chunk - 1) / chunk, [&](size_t worker, size_t task) {
+                        NUtils::TAlignedVector<TCoef>& acc = accs[worker];
+                        if (acc.empty()) {
+                            acc.resize(pivots);
+                        }
+                        for (size_t k = task * chunk; k < std::min(level.size(), (task + 1) * chunk); k++) {
+                            const size_t i = level[k];
+                            TCoef* row = reduced.matrix.Row(reduced.index[i]);
+                            const auto& b_columns = blocks.B.GetColumns(i);
+                            const auto& b_values = blocks.B.GetValues(i);
+                            for (size_t q = 0; q < b_columns.size(); q++) {
+                                row[b_columns[q]] = b_values[q];
+                            }
+                            const auto& a_columns = blocks.A.GetColumns(i);
+                            if (a_columns.empty()) {
+                                continue;
                             }
+                            const auto& a_values = blocks.A.GetValues(i);
+                            for (size_t q = 0; q < a_columns.size(); q++) {
+                                acc[a_columns[q]] = a_values[q];
+                            }
+                            operations[worker] += ReduceAccumulatorByPivots(blocks, acc, a_columns[0], row, &reduced);
+                        }
+                    });
+                }
+                if (stats) {
+                    for (size_t operation : operations) {
+                        stats->row_operations += operation;
+                    }
+                }
+                return reduced;
+            }
+
+            // Monte Carlo replacement of ReduceByPivots for prime fields other than F_2. Non pivot rows are split
+            // into groups of about sqrt(rows) rows. A random linear combination of a group with coefficients in
+            // 1..p-1 is reduced by A | B and by the rows found so far, a non zero result is kept as a new row. If the
+            // group still has rows outside the span of the found ones, the combination vanishes with probability at
+            // most 1/(p-1), so a group is dropped after s consecutive vanished combinations. Every group start and
+            // every found row begins such a run, so a row is lost with probability at most
+            // (rows + groups) * (p-1)^-s, and s is the least one keeping this below failure_probability. D is
+            // replaced in place by the found rows in row echelon form: the rows found in a group are collected in a
+            // group sized matrix and written over the rows of D already summed, so D keeps its storage.
+            template <typename TCoef>
+            void CompressByPivots(TBlockMatrix<TCoef>& blocks, double failure_probability, uint64_t seed, TMatrixReductionStats* stats, size_t memory_budget = 0) {
+                const int64_t p = NUtils::FieldSize<TCoef>;
+                const size_t rows = blocks.C.N_;
+                const size_t width = blocks.D.M_;
+                const size_t group = std::max<size_t>(1, std::ceil(std::sqrt(rows)));
+                const size_t groups = (rows + group - 1) / group;
+                auto bound = [&](size_t zeros) {
+                    return (rows + groups) * std::pow(p - 1, -double(zeros));
+                };
+                size_t zeros = 1;
+                while (bound(zeros) > failure_probability) {
+                    zeros++;
+                }
+                if (stats) {
+                    stats->failure_probability += bound(zeros);
+                }
+
+                std::mt19937_64 rng(seed);
+                NUtils::TAlignedVector<TCoef> acc(blocks.A.N_);
+                NUtils::Matrix<TCoef> fresh(std::min(group, rows), width, memory_budget); // rows found in the current group
+                std::vector<size_t> leading;
+                size_t written = 0; // found rows already in D
+                for (size_t start = 0; start < rows; start += group) {
+                    const size_t end = std::min(rows, start + group);
+                    size_t vanished = 0;
+                    size_t kept = 0;
+                    while (vanished < zeros && kept < end - start) {
+                        TCoef* d = fresh.Row(kept);
+                        size_t from = blocks.A.N_;
+                        for (size_t i = start; i < end; i++) {
+                            const TCoef factor = TCoef(0) - TCoef(int32_t(rng() % (p - 1) + 1));
+                            const auto& columns = blocks.C.GetColumns(i);
+                            NUtils::SubtractMultipleSparse(acc.data(), columns.data(), blocks.C.GetValues(i).data(), factor, columns.size());
+                            NUtils::SubtractMultiple(d, blocks.D.Row(i), factor, width);
+                            if (!columns.empty()) {
+                                from = std::min<size_t>(from, columns[0]);
+                            }
+                        }
+                        const size_t operations = ReduceAccumulatorByPivots(blocks, acc, from, d);
+                        if (stats) {
+                            stats->row_operations += operations;
+                        }
+                        for (size_t q = 0; q < leading.size(); q++) {
+                            const size_t j = leading[q];
+                            TCoef factor = d[j];
+                            if (factor != 0) {
+                                if (stats) {
+                                    stats->row_operations++;
+                                }
+                                const TCoef* row = q < written ? blocks.D.Row(q) : fresh.Row(q - written);
+                                NUtils::SubtractMultiple(d + j, row + j, factor, width - j);
+                            }
+                        }
+
+                        size_t j = 0;
+                        while (j < width && d[j] == 0) {
+                            j++;
+                        }
+                        if (j == width) {
+                            vanished++;
+                            continue;
+                        }
+                        TCoef inverse = TCoef(1) / d[j];
+                        for (size_t k = j; k < width; k++) {
+                            d[k] *= inverse;
                         }
+                        leading.push_back(j);
+                        kept++;
+                        vanished = 0;
+                    }
+                    // written + kept <= end, the rows of D up to end are not read any more.
+                    for (size_t q = 0; q < kept; q++) {
+                        std::copy(fresh.Row(q), fresh.Row(q) + width, blocks.D.Row(written + q));
+                        std::fill(fresh.Row(q), fresh.Row(q) + width, TCoef(0));
                     }
+                    written += kept;
                 }
+                blocks.D.TruncateRows(written);
+            }
+
+            // Reduced pivot rows of ReducePivots reduced by the echelonized D, which has to be in reduced form, as
+            // polynomials. They keep their leading terms.
+            template <typename TCoef, typename TComp>
+            NUtils::TPolynomials<TCoef, TComp> GetReducedPivotRows(TBlockMatrix<TCoef>& blocks, TReducedPivots<TCoef>& reduced, const std::vector<NUtils::Term>& vTerms, NUtils::ThreadPool& pool, TMatrixReductionStats* stats = nullptr) {
+                const size_t pivots = blocks.A.N_;
+                const size_t width = blocks.B.M_;
+                const bool hybrid = !blocks.H.empty();
+                std::vector<std::pair<size_t, size_t>> d_pivots; // (leading column, row of D)
+                for (size_t i = 0; i < (hybrid ? blocks.H.size() : blocks.D.N_); i++) {
+                    const size_t j = hybrid ? blocks.H[i].Leading(width) : std::find_if(blocks.D.Row(i), blocks.D.Row(i) + width, [](const TCoef& x) { return x != 0; }) - blocks.D.Row(i);
+                    if (j < width) {
+                        d_pivots.emplace_back(j, i);
+                    }
+                }
+
+                std::vector<size_t> rows;
+                for (size_t i = 0; i < pivots; i++) {
+                    if (reduced.index[i] != TReducedPivots<TCoef>::none) {
+                        rows.push_back(i);
+                    }
+                }
+                NUtils::TPolynomials<TCoef, TComp> polynomials(rows.size());
+                std::vector<size_t> operations(pool.Size());
+                pool.ParallelFor(rows.size(), [&](size_t worker, size_t k) {
+                    const size_t i = rows[k];
+                    TCoef* d = reduced.matrix.Row(reduced.index[i]);
+                    for (const auto& [j, row] : d_pivots) {
+                        TCoef factor = d[j];
+                        if (factor == 0) {
+                            continue;
+                        }
+                        operations[worker]++;
+                        if (hybrid) {
+                            blocks.H[row].SubtractMultipleFrom(d, factor, j);
+                        } else {
+                            NUtils::SubtractMultiple(d + j, blocks.D.Row(row) + j, factor, width - j);
+                        }
+                    }
+
+                    std::vector<NUtils::Monomial<TCoef>> mons;
+                    mons.emplace_back(vTerms[i], TCoef(1));
+                    for (size_t j = 0; j < width; j++) {
+                        if (d[j] != 0) {
+                            mons.emplace_back(vTerms[pivots + j], d[j]);
+                        }
+                    }
+                    polynomials[k] = NUtils::Polynomial<TCoef, TComp>(std::move(mons));
+                });
+                if (stats) {
+                    for (size_t count : operations) {
+                        stats->row_operations += count;
+                    }
+                }
+                return polynomials;
             }
 
             template <typename TCoef>
@@ -148,10 +1001,7 @@ namespace FF4 {
                             continue;
                         }
                         TCoef factor = matrix(i, j);
-
-                        for (size_t k = pivots; k < matrix.M_; k++) {
-                            matrix(i, k) -= factor * matrix(j, k);
-                        }
+                        NUtils::SubtractMultiple(matrix.Row(i) + pivots, matrix.Row(j) + pivots, factor, matrix.M_ - pivots);
 
                         matrix(i, j) = 0;
                     }
@@ -165,34 +1015,69 @@ namespace FF4 {
                         if (matrix(k, i) == 0) {
                             continue;
                         }
-                        for (size_t j = pivots; j < matrix.M_; j++) {
-                            matrix(k, j) -= matrix(k, i) * matrix(i, j);
-                        }
+                        TCoef factor = matrix(k, i);
+                        NUtils::SubtractMultiple(matrix.Row(k) + pivots, matrix.Row(i) + pivots, factor, matrix.M_ - pivots);
                         matrix(k, i) = 0;
                     }
                 }
             }
 
+            // If reduced_pivots is given and D is brought to the reduced form, the pivot rows chosen by ReducePivots
+            // are fully reduced and stored there.
+            // The given pool is used instead of a pool of options.threads workers of its own.
             template <typename TCoef, typename TComp>
-            NUtils::TPolynomials<TCoef, TComp> MatrixReduction(TSymbolicPreprocessingResult<TCoef, TComp>& L) {
+            NUtils::TPolynomials<TCoef, TComp> MatrixReduction(TSymbolicPreprocessingResult<TCoef, TComp>& L, const TMatrixReductionOptions& options = {}, NUtils::TPolynomials<TCoef, TComp>* reduced_pivots = nullptr, NUtils::ThreadPool* shared_pool = nullptr) {
                 std::vector<NUtils::Term>& diffSet = L.second;
-                NUtils::TPolynomials<TCoef, TComp>& F = L.first;
-                std::sort(F.begin(), F.end(), [](const NUtils::Polynomial<TCoef, TComp>& a, const NUtils::Polynomial<TCoef, TComp>& b){
-                    return TComp()(b, a);
+                TMultipliedRows<TCoef, TComp>& F = L.first;
+                std::sort(F.begin(), F.end(), [](const TMultipliedRow<TCoef, TComp>& a, const TMultipliedRow<TCoef, TComp>& b){
+                    return TComp()(b.leading, a.leading);
                 });
 
                 std::vector<NUtils::Term> vTerms(diffSet.size());
 
-                NUtils::Matrix<TCoef> matrix(F.size(), diffSet.size());
-                std::vector<std::vector<size_t>> nnext;
-                size_t pivots = FillMatrix(F, matrix, vTerms, diffSet, nnext);
-                NOTRSM(matrix, pivots, nnext); // switch comments, to test gbla.
-                // TRSM(matrix, pivots);
-                // AXPY(matrix, pivots);
-
-                GaussElimination(matrix, pivots);
+                NUtils::ThreadPool own_pool(shared_pool ? 1 : options.threads);
+                NUtils::ThreadPool& pool = shared_pool ? *shared_pool : own_pool;
+                const bool hybrid = options.storage == ERowStorage::Hybrid;
+                TBlockMatrix<TCoef> blocks = FillMatrix(F, vTerms, diffSet, hybrid, options.memory_budget);
+                // Reduced pivot rows also cut the cascade of ReduceByPivots short.
+                const bool reduce_pivots = reduced_pivots && options.echelon == EEchelonForm::Reduced;
+                TReducedPivots<TCoef> reduced;
+                if (reduce_pivots) {
+                    reduced = ReducePivots(blocks, pool, options.stats, options.memory_budget);
+                }
+                if constexpr (NUtils::FieldSize<TCoef> > 2) {
+                    if (!hybrid && options.failure_probability > 0) {
+                        CompressByPivots(blocks, options.failure_probability, options.seed, options.stats, options.memory_budget);
+                    } else {
+                        ReduceByPivots(blocks, pool, options.hybrid_density, options.stats, reduce_pivots ? &reduced : nullptr);
+                    }
+                } else {
+                    ReduceByPivots(blocks, pool, options.hybrid_density, options.stats, reduce_pivots ? &reduced : nullptr);
+                }
+                if (hybrid) {
+                    HybridGaussElimination(blocks.H, blocks.B.M_, options.hybrid_density, pool, options.echelon);
+                } else if (blocks.D.IsMapped()) {
+                    const size_t panel = std::max<size_t>(64, options.memory_budget / (2 * sizeof(TCoef) * blocks.D.N_));
+                    TiledGaussElimination(blocks.D, options.echelon, panel, panel, options.stats, &pool);
+                } else if (options.split_components) {
+                    ComponentGaussElimination(blocks.D, pool, options);
+                } else {
+                    EchelonizeDense(blocks.D, pool, options, options.stats);
+                }
+                if (options.stats) {
+                    options.stats->matrices++;
+                    for (const auto& row : F) {
+                        options.stats->entries += row.polynomial->GetMonomials().size();
+                    }
+                }
+                if (reduce_pivots) {
+                    *reduced_pivots = GetReducedPivotRows<TCoef, TComp>(blocks, reduced, vTerms, pool, options.stats);
+                }
 
-                return GetReducedPolynomials<TCoef, TComp>(matrix, vTerms, pivots);
+                if (hybrid) {
+                    return GetReducedPolynomials<TCoef, TComp>(blocks.H, vTerms, blocks.A.N_);
+                }
+                return GetReducedPolynomials<TCoef, TComp>(blocks.D, vTerms, blocks.A.N_);
             }
         }
     }
@@ -0,0 +1,60 @@
+#pragma once
+#include <cstddef>
+#include <new>
+#include <vector>
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace FF4 {
+    namespace NUtils {
+        constexpr size_t CacheLineSize = 64;
+
+        // Allocator for matrix rows and accumulators. Buffers start on a cache line, so rows padded to whole lines
+        // have the same alignment at every column. Buffers of at least a huge page are aligned to it and marked
+        // for transparent huge pages, which removes most TLB misses of the scattered accesses into long rows.
+        template <typename T>
+        class AlignedAllocator {
+        public:
+            using value_type = T;
+
+            static constexpr size_t HugePageSize = 2 << 20;
+
+            AlignedAllocator() = default;
+
+            template <typename U>
+            AlignedAllocator(const AlignedAllocator<U>&) noexcept {
+            }
+
+            T* allocate(size_t n) {
+                const size_t bytes = n * sizeof(T);
+                if (bytes < HugePageSize) {
+                    return static_cast<T*>(::operator new(bytes, std::align_val_t(CacheLineSize)));
+                }
+                const size_t rounded = (bytes + HugePageSize - 1) / HugePageSize * HugePageSize;
+                void* data = ::operator new(rounded, std::align_val_t(HugePageSize));
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+                madvise(data, rounded, MADV_HUGEPAGE);
+#endif
+                return static_cast<T*>(data);
+            }
+
+            void deallocate(T* data, size_t n) noexcept {
+                const size_t bytes = n * sizeof(T);
+                if (bytes < HugePageSize) {
+                    ::operator delete(data, std::align_val_t(CacheLineSize));
+                } else {
+                    ::operator delete(data, std::align_val_t(HugePageSize));
+                }
+            }
+
+            template <typename U>
+            friend bool operator==(const AlignedAllocator&, const AlignedAllocator<U>&) noexcept {
+                return true;
+            }
+        };
+
+        template <typename T>
+        using TAlignedVector = std::vector<T, AlignedAllocator<T>>;
+    }
+}
@@ -11,6 +11,15 @@ namespace FF4 {
                 return left.GetData() < right.GetData();
             }
 
+            // Writes digits whose lexicographic order is the order of the terms in the given number of variables,
+            // returns their count, at most variables + 1.
+            static size_t OrderKey(const Term& term, size_t variables, uint16_t* digits) noexcept {
+                for (size_t i = 0; i < variables; i++) {
+                    digits[i] = i < term.size() ? term[i] : 0;
+                }
+                return variables;
+            }
+
             template <typename T>
             bool operator()(const Monomial<T>& left, const Monomial<T>& right) const noexcept {
                 assert(left.GetCoef() != 0);
@@ -43,6 +52,14 @@ namespace FF4 {
                 return false;
             }
 
+            static size_t OrderKey(const Term& term, size_t variables, uint16_t* digits) noexcept {
+                for (size_t i = 0; i < variables; i++) {
+                    const size_t j = variables - 1 - i;
+                    digits[i] = UINT16_MAX - (j < term.size() ? term[j] : 0);
+                }
+                return variables;
+            }
+
             template <typename T>
             bool operator()(const Monomial<T>& left, const Monomial<T>& right) const noexcept {
                 assert(left.GetCoef() != 0);
@@ -63,6 +80,11 @@ namespace FF4 {
                 return RevLexComp()(left, right);
             }
 
+            static size_t OrderKey(const Term& term, size_t variables, uint16_t* digits) noexcept {
+                digits[0] = term.TotalDegree();
+                return RevLexComp::OrderKey(term, variables, digits + 1) + 1;
+            }
+
             template <typename T>
             bool operator()(const Monomial<T>& left, const Monomial<T>& right) const noexcept {
                 assert(left.GetCoef() != 0);
@@ -0,0 +1,177 @@
+#pragma once
+#include "aligned_allocator.h"
+#include "row_operations.h"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace FF4 {
+    namespace NUtils {
+        // Matrix row of a fixed width which is kept as sorted (column, value) pairs while it is sparse and
+        // switches to a dense array once the share of non zeros goes above the given density.
+        template <typename TCoef>
+        class HybridRow {
+        public:
+            HybridRow() = default;
+
+            bool IsDense() const noexcept {
+                return is_dense_;
+            }
+
+            // Entries of a sparse row are expected to be pushed in increasing column order.
+            void PushBack(uint32_t column, const TCoef& value) {
+                columns_.push_back(column);
+                values_.push_back(value);
+            }
+
+            // Takes the non zeros of data[0, width) and zeroes data.
+            void Assign(TCoef* data, size_t width, double density) {
+                size_t cnt = 0;
+                for (size_t i = 0; i < width; i++) {
+                    if (data[i] != 0) {
+                        cnt++;
+                    }
+                }
+                columns_.clear();
+                values_.clear();
+                dense_.clear();
+                is_dense_ = cnt > density * width;
+                if (is_dense_) {
+                    dense_.assign(data, data + width);
+                } else {
+                    columns_.reserve(cnt);
+                    values_.reserve(cnt);
+                    for (size_t i = 0; i < width; i++) {
+                        if (data[i] != 0) {
+                            PushBack(i, data[i]);
+                        }
+                    }
+                }
+                std::fill(data, data + width, TCoef(0));
+            }
+
+            void ToDense(size_t width) {
+                if (is_dense_) {
+                    return;
+                }
+                dense_.assign(width, TCoef(0));
+                for (size_t i = 0; i < columns_.size(); i++) {
+                    dense_[columns_[i]] = values_[i];
+                }
+                columns_ = std::vector<uint32_t>();
+                values_ = std::vector<TCoef>();
+                is_dense_ = true;
+            }
+
+            // First non zero column, width for a zero row.
+            size_t Leading(size_t width) const {
+                if (!is_dense_) {
+                    return columns_.empty() ? width : columns_[0];
+                }
+                size_t j = 0;
+                while (j < width && dense_[j] == 0) {
+                    j++;
+                }
+                return j;
+            }
+
+            TCoef Get(size_t column) const {
+                if (is_dense_) {
+                    return dense_[column];
+                }
+                auto it = std::lower_bound(columns_.begin(), columns_.end(), column);
+                if (it == columns_.end() || *it != column) {
+                    return TCoef(0);
+                }
+                return values_[it - columns_.begin()];
+            }
+
+            template <typename TFunction>
+            void ForEachNonZero(TFunction function) const {
+                if (!is_dense_) {
+                    for (size_t i = 0; i < columns_.size(); i++) {
+                        function(columns_[i], values_[i]);
+                    }
+                    return;
+                }
+                for (size_t i = 0; i < dense_.size(); i++) {
+                    if (dense_[i] != 0) {
+                        function(i, dense_[i]);
+                    }
+                }
+            }
+
+            void Scale(const TCoef& factor) {
+                TCoef* data = is_dense_ ? dense_.data() : values_.data();
+                const size_t size = is_dense_ ? dense_.size() : values_.size();
+                for (size_t i = 0; i < size; i++) {
+                    data[i] *= factor;
+                }
+            }
+
+            // row -= factor * this for a dense row, where this is zero before column from.
+            void SubtractMultipleFrom(TCoef* row, const TCoef& factor, size_t from) const {
+                if (is_dense_) {
+                    NUtils::SubtractMultiple(row + from, dense_.data() + from, factor, dense_.size() - from);
+                } else {
+                    NUtils::SubtractMultipleSparse(row, columns_.data(), values_.data(), factor, columns_.size());
+                }
+            }
+
+            // this -= factor * pivot, where pivot is zero before column from.
+            void SubtractMultiple(const HybridRow& pivot, const TCoef& factor, size_t from, size_t width, double density) {
+                if (!is_dense_ && pivot.is_dense_) {
+                    ToDense(width);
+                }
+                if (is_dense_) {
+                    if (pivot.is_dense_) {
+                        NUtils::SubtractMultiple(dense_.data() + from, pivot.dense_.data() + from, factor, width - from);
+                    } else {
+                        NUtils::SubtractMultipleSparse(dense_.data(), pivot.columns_.data(), pivot.values_.data(), factor, pivot.columns_.size());
+                    }
+                    return;
+                }
+                SubtractMultipleSparseSparse(pivot, factor);
+                if (columns_.size() > density * width) {
+                    ToDense(width);
+                }
+            }
+
+        private:
+            void SubtractMultipleSparseSparse(const HybridRow& pivot, const TCoef& factor) {
+                std::vector<uint32_t> columns;
+                std::vector<TCoef> values;
+                columns.reserve(columns_.size() + pivot.columns_.size());
+                values.reserve(columns_.size() + pivot.columns_.size());
+                size_t i = 0;
+                size_t j = 0;
+                while (i < columns_.size() || j < pivot.columns_.size()) {
+                    if (j == pivot.columns_.size() || (i < columns_.size() && columns_[i] < pivot.columns_[j])) {
+                        columns.push_back(columns_[i]);
+                        values.push_back(values_[i]);
+                        i++;
+                    } else if (i == columns_.size() || pivot.columns_[j] < columns_[i]) {
+                        columns.push_back(pivot.columns_[j]);
+                        values.push_back(TCoef(0) - factor * pivot.values_[j]);
+                        j++;
+                    } else {
+                        TCoef value = values_[i] - factor * pivot.values_[j];
+                        if (value != 0) {
+                            columns.push_back(columns_[i]);
+                            values.push_back(value);
+                        }
+                        i++;
+                        j++;
+                    }
+                }
+                columns_ = std::move(columns);
+                values_ = std::move(values);
+            }
+
+            std::vector<uint32_t> columns_;
+            std::vector<TCoef> values_;
+            TAlignedVector<TCoef> dense_;
+            bool is_dense_ = false;
+        };
+    }
+}
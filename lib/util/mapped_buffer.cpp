@@ -0,0 +1,67 @@
+#include "mapped_buffer.h"
+
+#include <cstdlib>
+#include <string>
+#include <utility>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace FF4 {
+    namespace NUtils {
+        MappedBuffer::MappedBuffer(size_t bytes) {
+            if (bytes == 0) {
+                return;
+            }
+            const char* directory = std::getenv("TMPDIR");
+            std::string path = std::string(directory && *directory ? directory : "/tmp") + "/ff4-matrix-XXXXXX";
+            const int fd = mkstemp(path.data());
+            if (fd < 0) {
+                return;
+            }
+            unlink(path.c_str());
+            if (ftruncate(fd, bytes) == 0) {
+                void* data = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                if (data != MAP_FAILED) {
+                    data_ = data;
+                    size_ = bytes;
+                }
+            }
+            close(fd);
+        }
+
+        MappedBuffer::~MappedBuffer() {
+            Reset();
+        }
+
+        MappedBuffer::MappedBuffer(MappedBuffer&& other) noexcept
+        : data_(std::exchange(other.data_, nullptr))
+        , size_(std::exchange(other.size_, 0))
+        {
+        }
+
+        MappedBuffer& MappedBuffer::operator=(MappedBuffer&& other) noexcept {
+            if (this != &other) {
+                Reset();
+                data_ = std::exchange(other.data_, nullptr);
+                size_ = std::exchange(other.size_, 0);
+            }
+            return *this;
+        }
+
+        void* MappedBuffer::Data() const noexcept {
+            return data_;
+        }
+
+        size_t MappedBuffer::Size() const noexcept {
+            return size_;
+        }
+
+        void MappedBuffer::Reset() noexcept {
+            if (data_) {
+                munmap(data_, size_);
+            }
+            data_ = nullptr;
+            size_ = 0;
+        }
+    }
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <cstddef>
+
+namespace FF4 {
+    namespace NUtils {
+        // Zero filled buffer backed by a temporary file mapped into memory. The file is unlinked at once, so the
+        // kernel writes its pages back to disk under memory pressure instead of failing the allocation.
+        // The directory is $TMPDIR or /tmp. Data() is null if the file could not be created or mapped.
+        class MappedBuffer {
+        public:
+            MappedBuffer() = default;
+            explicit MappedBuffer(size_t bytes);
+            ~MappedBuffer();
+
+            MappedBuffer(const MappedBuffer&) = delete;
+            MappedBuffer& operator=(const MappedBuffer&) = delete;
+            MappedBuffer(MappedBuffer&& other) noexcept;
+            MappedBuffer& operator=(MappedBuffer&& other) noexcept;
+
+            void* Data() const noexcept;
+            size_t Size() const noexcept;
+
+        private:
+            void Reset() noexcept;
+
+            void* data_ = nullptr;
+            size_t size_ = 0;
+        };
+    }
+}
@@ -1,4 +1,10 @@
 #pragma once
+#include "aligned_allocator.h"
+#include "mapped_buffer.h"
+#include "prime_field.h"
+#include <algorithm>
+#include <cstdint>
+#include <span>
 #include <vector>
 
 namespace FF4 {
@@ -8,25 +14,166 @@ namespace FF4 {
         public:
             Matrix() = delete;
 
-            Matrix(size_t n, size_t m)
+            // Matrices over prime fields taking more than memory_budget bytes are kept in a MappedBuffer,
+            // zero means no limit. Zero of a prime field is all zero bits, as a fresh mapping is.
+            Matrix(size_t n, size_t m, size_t memory_budget = 0)
             : N_(n)
             , M_(m)
+            , stride_(Stride(m))
             {
-                data_.resize(N_ * M_);
+                if constexpr (FieldSize<TCoef> != 0) {
+                    if (memory_budget != 0 && N_ * stride_ * sizeof(TCoef) > memory_budget) {
+                        mapped_ = MappedBuffer(N_ * stride_ * sizeof(TCoef));
+                    }
+                }
+                Allocate();
+            }
+
+            // A copy of a mapped matrix is mapped too.
+            Matrix(const Matrix& other)
+            : N_(other.N_)
+            , M_(other.M_)
+            , stride_(other.stride_)
+            {
+                if (other.IsMapped()) {
+                    mapped_ = MappedBuffer(N_ * stride_ * sizeof(TCoef));
+                }
+                Allocate();
+                std::copy(other.data_, other.data_ + N_ * stride_, data_);
+            }
+
+            Matrix(Matrix&& other) noexcept
+            : N_(other.N_)
+            , M_(other.M_)
+            , stride_(other.stride_)
+            , storage_(std::move(other.storage_))
+            , mapped_(std::move(other.mapped_))
+            {
+                Point();
+                other.Point();
+            }
+
+            Matrix& operator=(const Matrix& other) {
+                if (this != &other) {
+                    *this = Matrix(other);
+                }
+                return *this;
+            }
+
+            Matrix& operator=(Matrix&& other) noexcept {
+                N_ = other.N_;
+                M_ = other.M_;
+                stride_ = other.stride_;
+                storage_ = std::move(other.storage_);
+                mapped_ = std::move(other.mapped_);
+                Point();
+                other.Point();
+                return *this;
+            }
+
+            // Keeps the first n <= N_ rows, the storage is not released.
+            void TruncateRows(size_t n) noexcept {
+                N_ = n;
+            }
+
+            bool IsMapped() const noexcept {
+                return mapped_.Data() != nullptr;
             }
 
             TCoef& operator()(size_t i, size_t j) {
-                return data_[i * M_ + j];
+                return data_[i * stride_ + j];
             }
 
             const TCoef& operator()(size_t i, size_t j) const {
-                return data_[i * M_ + j];
+                return data_[i * stride_ + j];
+            }
+
+            // Rows are M_ entries long, they are not contiguous if padded.
+            TCoef* Row(size_t i) {
+                return data_ + i * stride_;
+            }
+
+            const TCoef* Row(size_t i) const {
+                return data_ + i * stride_;
+            }
+
+            size_t N_;
+            size_t M_;
+        private:
+            // Rows of at least four cache lines are padded to whole lines, every row then starts on a line and
+            // the padding costs at most a fifth of the memory.
+            static size_t Stride(size_t m) noexcept {
+                constexpr size_t line = CacheLineSize / sizeof(TCoef);
+                if (line <= 1 || m < 4 * line) {
+                    return m;
+                }
+                return (m + line - 1) / line * line;
+            }
+
+            void Allocate() {
+                if (!IsMapped()) {
+                    storage_.resize(N_ * stride_);
+                }
+                Point();
+            }
+
+            void Point() noexcept {
+                data_ = IsMapped() ? static_cast<TCoef*>(mapped_.Data()) : storage_.data();
+            }
+
+            size_t stride_;
+            TAlignedVector<TCoef> storage_;
+            MappedBuffer mapped_;
+            TCoef* data_ = nullptr;
+        };
+
+        // Rows are stored one after another in two flat buffers, offsets_[i] is the start of row i.
+        template <typename TCoef>
+        class SparseMatrix {
+        public:
+            using TIndex = uint32_t;
+
+            SparseMatrix() = delete;
+
+            SparseMatrix(size_t n, size_t m)
+            : N_(n)
+            , M_(m)
+            , offsets_(n)
+            {
+            }
+
+            // Rows are expected to be pushed in increasing order, entries of a row in increasing column order.
+            void PushBack(size_t i, TIndex j, const TCoef& value) {
+                while (rows_ <= i) {
+                    offsets_[rows_++] = columns_.size();
+                }
+                columns_.push_back(j);
+                values_.push_back(value);
+            }
+
+            std::span<const TIndex> GetColumns(size_t i) const noexcept {
+                return {columns_.data() + Begin(i), columns_.data() + End(i)};
+            }
+
+            std::span<const TCoef> GetValues(size_t i) const noexcept {
+                return {values_.data() + Begin(i), values_.data() + End(i)};
             }
 
             size_t N_;
             size_t M_;
         private:
-            std::vector<TCoef> data_;
+            size_t Begin(size_t i) const noexcept {
+                return i < rows_ ? offsets_[i] : columns_.size();
+            }
+
+            size_t End(size_t i) const noexcept {
+                return i + 1 < rows_ ? offsets_[i + 1] : columns_.size();
+            }
+
+            std::vector<size_t> offsets_;
+            size_t rows_ = 0; // rows with a known start
+            std::vector<TIndex> columns_;
+            std::vector<TCoef> values_;
         };
     }
 }
@@ -1,4 +1,5 @@
 #pragma once
+#include <cassert>
 #include <cstdint>
 #include <iostream>
 
@@ -53,6 +54,10 @@ namespace FF4 {
                 return !(left == right);
             }
 
+            int32_t GetValue() const noexcept {
+                return number_;
+            }
+
             bool IsPositive() const noexcept {
                 return number_ != 0 && number_ != Mod - 1;
             }
@@ -119,5 +124,12 @@ namespace FF4 {
         private:
             int32_t number_ = 0;
         };
+
+        // Number of elements of the coefficient field, 0 for infinite fields.
+        template <typename TCoef>
+        constexpr int64_t FieldSize = 0;
+
+        template <int32_t Mod>
+        constexpr int64_t FieldSize<PrimeField<Mod>> = Mod;
     }
 }
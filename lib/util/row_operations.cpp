@@ -0,0 +1,192 @@
+#include "row_operations.h"
+
+#include <algorithm>
+
+#ifdef FF4_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+// All kernels use Shoup's modular multiplication: for a fixed factor w and w' = floor(w * 2^32 / p),
+// x * w mod p = x * w - hi32(x * w') * p, up to one correction by p. It needs only 32 bit lane
+// arithmetic and no division in the loop. Vector kernels clear the upper register halves before returning,
+// otherwise the SSE code of the rest of the program pays for AVX state transitions. Dense vector kernels
+// go scalar up to the vector alignment of row and then store aligned. Rows of a Matrix padded to cache
+// lines have the same alignment at every column, so the pivot loads are aligned as well.
+
+namespace FF4 {
+    namespace NUtils {
+        namespace NKernels {
+            namespace {
+                uint32_t ShoupFactor(uint32_t factor, uint32_t p) noexcept {
+                    return (static_cast<uint64_t>(factor) << 32) / p;
+                }
+
+                uint32_t SubtractProductModP(uint32_t y, uint32_t x, uint32_t factor, uint32_t wp, uint32_t p) noexcept {
+                    const uint32_t q = (static_cast<uint64_t>(x) * wp) >> 32;
+                    uint32_t r = x * factor - q * p;
+                    if (r >= p) {
+                        r -= p;
+                    }
+                    return y >= r ? y - r : y + p - r;
+                }
+
+                void PrefetchForWrite(const uint32_t* address) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+                    __builtin_prefetch(address, 1);
+#endif
+                }
+
+#ifdef FF4_X86_KERNELS
+                // Number of leading entries of row to skip for row + head to be aligned to the given bytes, at most n.
+                size_t AlignmentHead(const uint32_t* row, size_t alignment, size_t n) noexcept {
+                    const size_t misalignment = reinterpret_cast<uintptr_t>(row) % alignment;
+                    if (misalignment == 0) {
+                        return 0;
+                    }
+                    return std::min(n, (alignment - misalignment) / sizeof(uint32_t));
+                }
+#endif
+
+                using TKernel = void (*)(uint32_t*, const uint32_t*, uint32_t, uint32_t, size_t) noexcept;
+                using TSparseKernel = void (*)(uint32_t*, const uint32_t*, const uint32_t*, uint32_t, uint32_t, size_t) noexcept;
+
+                TKernel SelectKernel() noexcept {
+#ifdef FF4_X86_KERNELS
+                    __builtin_cpu_init();
+                    if (__builtin_cpu_supports("avx512f")) {
+                        return SubtractMultipleModPAvx512;
+                    }
+                    if (__builtin_cpu_supports("avx2")) {
+                        return SubtractMultipleModPAvx2;
+                    }
+#endif
+                    return SubtractMultipleModPScalar;
+                }
+
+                TSparseKernel SelectSparseKernel() noexcept {
+#ifdef FF4_X86_KERNELS
+                    __builtin_cpu_init();
+                    if (__builtin_cpu_supports("avx512f")) {
+                        return SubtractMultipleSparseModPAvx512;
+                    }
+#endif
+                    return SubtractMultipleSparseModPScalar;
+                }
+            }
+
+#ifdef FF4_X86_KERNELS
+            __attribute__((target("avx2")))
+            void SubtractMultipleModPAvx2(uint32_t* row, const uint32_t* pivot, uint32_t factor, uint32_t p, size_t n) noexcept {
+                const __m256i w = _mm256_set1_epi32(factor);
+                const __m256i wp = _mm256_set1_epi32(ShoupFactor(factor, p));
+                const __m256i vp = _mm256_set1_epi32(p);
+                size_t i = AlignmentHead(row, 32, n);
+                SubtractMultipleModPScalar(row, pivot, factor, p, i);
+                for (; i + 8 <= n; i += 8) {
+                    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pivot + i));
+                    __m256i y = _mm256_load_si256(reinterpret_cast<const __m256i*>(row + i));
+                    __m256i even = _mm256_srli_epi64(_mm256_mul_epu32(x, wp), 32);
+                    __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(x, 32), wp);
+                    __m256i q = _mm256_blend_epi32(even, odd, 0xAA);
+                    __m256i r = _mm256_sub_epi32(_mm256_mullo_epi32(x, w), _mm256_mullo_epi32(q, vp));
+                    r = _mm256_min_epu32(r, _mm256_sub_epi32(r, vp));
+                    __m256i t = _mm256_sub_epi32(y, r);
+                    t = _mm256_min_epu32(t, _mm256_add_epi32(t, vp));
+                    _mm256_store_si256(reinterpret_cast<__m256i*>(row + i), t);
+                }
+                _mm256_zeroupper();
+                SubtractMultipleModPScalar(row + i, pivot + i, factor, p, n - i);
+            }
+
+            __attribute__((target("avx512f")))
+            void SubtractMultipleModPAvx512(uint32_t* row, const uint32_t* pivot, uint32_t factor, uint32_t p, size_t n) noexcept {
+                const __m512i w = _mm512_set1_epi32(factor);
+                const __m512i wp = _mm512_set1_epi32(ShoupFactor(factor, p));
+                const __m512i vp = _mm512_set1_epi32(p);
+                size_t i = AlignmentHead(row, 64, n);
+                SubtractMultipleModPScalar(row, pivot, factor, p, i);
+                for (; i + 16 <= n; i += 16) {
+                    __m512i x = _mm512_loadu_si512(pivot + i);
+                    __m512i y = _mm512_load_si512(row + i);
+                    __m512i even = _mm512_srli_epi64(_mm512_mul_epu32(x, wp), 32);
+                    __m512i odd = _mm512_mul_epu32(_mm512_srli_epi64(x, 32), wp);
+                    __m512i q = _mm512_mask_blend_epi32(0xAAAA, even, odd);
+                    __m512i r = _mm512_sub_epi32(_mm512_mullo_epi32(x, w), _mm512_mullo_epi32(q, vp));
+                    r = _mm512_min_epu32(r, _mm512_sub_epi32(r, vp));
+                    __m512i t = _mm512_sub_epi32(y, r);
+                    t = _mm512_min_epu32(t, _mm512_add_epi32(t, vp));
+                    _mm512_store_si512(row + i, t);
+                }
+                _mm256_zeroupper();
+                SubtractMultipleModPScalar(row + i, pivot + i, factor, p, n - i);
+            }
+
+            __attribute__((target("avx512f")))
+            void SubtractMultipleSparseModPAvx512(uint32_t* row, const uint32_t* columns, const uint32_t* values, uint32_t factor, uint32_t p, size_t n) noexcept {
+                const __m512i w = _mm512_set1_epi32(factor);
+                const __m512i wp = _mm512_set1_epi32(ShoupFactor(factor, p));
+                const __m512i vp = _mm512_set1_epi32(p);
+                size_t i = 0;
+                for (; i + 16 <= n; i += 16) {
+                    __m512i index = _mm512_loadu_si512(columns + i);
+                    __m512i x = _mm512_loadu_si512(values + i);
+                    __m512i y = _mm512_i32gather_epi32(index, row, 4);
+                    __m512i even = _mm512_srli_epi64(_mm512_mul_epu32(x, wp), 32);
+                    __m512i odd = _mm512_mul_epu32(_mm512_srli_epi64(x, 32), wp);
+                    __m512i q = _mm512_mask_blend_epi32(0xAAAA, even, odd);
+                    __m512i r = _mm512_sub_epi32(_mm512_mullo_epi32(x, w), _mm512_mullo_epi32(q, vp));
+                    r = _mm512_min_epu32(r, _mm512_sub_epi32(r, vp));
+                    __m512i t = _mm512_sub_epi32(y, r);
+                    t = _mm512_min_epu32(t, _mm512_add_epi32(t, vp));
+                    _mm512_i32scatter_epi32(row, index, t, 4);
+                }
+                _mm256_zeroupper();
+                SubtractMultipleSparseModPScalar(row, columns + i, values + i, factor, p, n - i);
+            }
+#endif
+
+            void SubtractMultipleModPScalar(uint32_t* row, const uint32_t* pivot, uint32_t factor, uint32_t p, size_t n) noexcept {
+                const uint32_t wp = ShoupFactor(factor, p);
+                for (size_t i = 0; i < n; i++) {
+                    row[i] = SubtractProductModP(row[i], pivot[i], factor, wp, p);
+                }
+            }
+
+            void SubtractMultipleModP(uint32_t* row, const uint32_t* pivot, uint32_t factor, uint32_t p, size_t n) noexcept {
+                static const TKernel kernel = SelectKernel();
+                kernel(row, pivot, factor, p, n);
+            }
+
+            // Scattered accesses into a long dense row mostly miss the cache, so the row entries needed
+            // a few iterations ahead are prefetched and the loop is unrolled to keep several misses in flight.
+            void SubtractMultipleSparseModPScalar(uint32_t* row, const uint32_t* columns, const uint32_t* values, uint32_t factor, uint32_t p, size_t n) noexcept {
+                constexpr size_t prefetch_distance = 16;
+                const uint32_t wp = ShoupFactor(factor, p);
+                size_t i = 0;
+                for (; i + prefetch_distance + 4 <= n; i += 4) {
+                    PrefetchForWrite(row + columns[i + prefetch_distance]);
+                    PrefetchForWrite(row + columns[i + prefetch_distance + 1]);
+                    PrefetchForWrite(row + columns[i + prefetch_distance + 2]);
+                    PrefetchForWrite(row + columns[i + prefetch_distance + 3]);
+                    uint32_t& y0 = row[columns[i]];
+                    y0 = SubtractProductModP(y0, values[i], factor, wp, p);
+                    uint32_t& y1 = row[columns[i + 1]];
+                    y1 = SubtractProductModP(y1, values[i + 1], factor, wp, p);
+                    uint32_t& y2 = row[columns[i + 2]];
+                    y2 = SubtractProductModP(y2, values[i + 2], factor, wp, p);
+                    uint32_t& y3 = row[columns[i + 3]];
+                    y3 = SubtractProductModP(y3, values[i + 3], factor, wp, p);
+                }
+                for (; i < n; i++) {
+                    uint32_t& y = row[columns[i]];
+                    y = SubtractProductModP(y, values[i], factor, wp, p);
+                }
+            }
+
+            void SubtractMultipleSparseModP(uint32_t* row, const uint32_t* columns, const uint32_t* values, uint32_t factor, uint32_t p, size_t n) noexcept {
+                static const TSparseKernel kernel = SelectSparseKernel();
+                kernel(row, columns, values, factor, p, n);
+            }
+        }
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include "prime_field.h"
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define FF4_X86_KERNELS
+#endif
+
+namespace FF4 {
+    namespace NUtils {
+        namespace NKernels {
+            // row[i] = (row[i] - factor * pivot[i]) mod p for i < n, all values are in [0, p), p < 2^31.
+            // Picks an AVX-512 or AVX2 implementation on the first call if the CPU supports it.
+            void SubtractMultipleModP(uint32_t* row, const uint32_t* pivot, uint32_t factor, uint32_t p, size_t n) noexcept;
+
+            void SubtractMultipleModPScalar(uint32_t* row, const uint32_t* pivot, uint32_t factor, uint32_t p, size_t n) noexcept;
+
+            // row[columns[i]] = (row[columns[i]] - factor * values[i]) mod p for i < n, columns are distinct.
+            // Uses AVX-512 gather/scatter if the CPU supports it.
+            void SubtractMultipleSparseModP(uint32_t* row, const uint32_t* columns, const uint32_t* values, uint32_t factor, uint32_t p, size_t n) noexcept;
+
+            void SubtractMultipleSparseModPScalar(uint32_t* row, const uint32_t* columns, const uint32_t* values, uint32_t factor, uint32_t p, size_t n) noexcept;
+
+#ifdef FF4_X86_KERNELS
+            // Implementations behind the dispatch, only to be called if __builtin_cpu_supports the instruction set.
+            __attribute__((target("avx2")))
+            void SubtractMultipleModPAvx2(uint32_t* row, const uint32_t* pivot, uint32_t factor, uint32_t p, size_t n) noexcept;
+
+            __attribute__((target("avx512f")))
+            void SubtractMultipleModPAvx512(uint32_t* row, const uint32_t* pivot, uint32_t factor, uint32_t p, size_t n) noexcept;
+
+            __attribute__((target("avx512f")))
+            void SubtractMultipleSparseModPAvx512(uint32_t* row, const uint32_t* columns, const uint32_t* values, uint32_t factor, uint32_t p, size_t n) noexcept;
+#endif
+        }
+
+        // row -= factor * pivot for two contiguous rows of length n.
+        template <typename TCoef>
+        void SubtractMultiple(TCoef* row, const TCoef* pivot, const TCoef& factor, size_t n) {
+            for (size_t i = 0; i < n; i++) {
+                row[i] -= factor * pivot[i];
+            }
+        }
+
+        template <int32_t Mod>
+        void SubtractMultiple(PrimeField<Mod>* row, const PrimeField<Mod>* pivot, const PrimeField<Mod>& factor, size_t n) {
+            static_assert(sizeof(PrimeField<Mod>) == sizeof(uint32_t));
+            NKernels::SubtractMultipleModP(reinterpret_cast<uint32_t*>(row), reinterpret_cast<const uint32_t*>(pivot), factor.GetValue(), Mod, n);
+        }
+
+        // row -= factor * pivot for a dense row and a sparse pivot given by n (column, value) pairs.
+        template <typename TCoef>
+        void SubtractMultipleSparse(TCoef* row, const uint32_t* columns, const TCoef* values, const TCoef& factor, size_t n) {
+            for (size_t i = 0; i < n; i++) {
+                row[columns[i]] -= factor * values[i];
+            }
+        }
+
+        template <int32_t Mod>
+        void SubtractMultipleSparse(PrimeField<Mod>* row, const uint32_t* columns, const PrimeField<Mod>* values, const PrimeField<Mod>& factor, size_t n) {
+            static_assert(sizeof(PrimeField<Mod>) == sizeof(uint32_t));
+            NKernels::SubtractMultipleSparseModP(reinterpret_cast<uint32_t*>(row), columns, reinterpret_cast<const uint32_t*>(values), factor.GetValue(), Mod, n);
+        }
+    }
+}
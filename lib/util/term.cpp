@@ -42,6 +42,15 @@ namespace FF4 {
             data_.push_back(value);
         }
 
+        void Term::assign(const uint16_t* first, const uint16_t* last) {
+            data_.assign(first, last);
+            sum_ = 0;
+            for (uint16_t x : data_) {
+                sum_ += x;
+            }
+            Normalize();
+        }
+
         bool Term::IsOne() const noexcept {
             return sum_ == 0;
         }
@@ -167,6 +176,19 @@ namespace FF4 {
             return term;
         }
 
+        uint64_t DivisibilityMask(const Term& term) noexcept {
+            static constexpr uint16_t thresholds[] = {0, 1, 3, 7};
+            uint64_t mask = 0;
+            for (size_t i = 0; i < term.size(); i++) {
+                for (size_t k = 0; k < 4; k++) {
+                    if (term[i] > thresholds[k]) {
+                        mask |= uint64_t(1) << ((i % 16) * 4 + k);
+                    }
+                }
+            }
+            return mask;
+        }
+
         void Term::Normalize() {
             while(data_.size() > 1 && data_.back() == 0) {
                 data_.pop_back();
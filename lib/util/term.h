@@ -20,6 +20,7 @@ namespace FF4 {
                 size_t size() const;
                 void reserve(size_t);
                 void push_back(uint16_t);
+                void assign(const uint16_t* first, const uint16_t* last);
 
                 bool IsOne() const noexcept;
                 bool IsDivisibleBy(const Term&) const noexcept;
@@ -46,6 +47,11 @@ namespace FF4 {
                 Degree sum_ = 0;
         };
 
+        // Bits which are set in the mask of every multiple of the term: four per variable for the exponents above
+        // 0, 1, 3 and 7, variables past the sixteenth share the bits. If a divides b, the mask of a is a subset of
+        // the mask of b, so a failed subset test rules out divisibility.
+        uint64_t DivisibilityMask(const Term&) noexcept;
+
         struct TermHasher {
             size_t operator()(const FF4::NUtils::Term& t) const noexcept {
                 const std::vector<uint16_t>& data = t.GetData();
@@ -0,0 +1,175 @@
+#pragma once
+#include "term.h"
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace FF4 {
+    namespace NUtils {
+        // Open addressing set of terms with linear probing. Exponents of the terms are kept one after another in a
+        // flat arena in the order of insertion and terms are addressed by their index there, the table stores the
+        // hash next to the index, so a probe compares exponents only when the hashes are equal. Clear keeps the
+        // memory for the next use, no term is freed or allocated again.
+        class TermHashSet {
+            public:
+                static constexpr size_t NotFound = static_cast<size_t>(-1);
+
+                size_t Size() const noexcept {
+                    return offsets_.size();
+                }
+
+                bool Empty() const noexcept {
+                    return offsets_.empty();
+                }
+
+                // term = the term with index i in the order of insertion, the storage of term is reused.
+                void Get(size_t i, Term& term) const {
+                    term.assign(exponents_.data() + offsets_[i], exponents_.data() + End(i));
+                }
+
+                size_t Find(const Term& term) const noexcept {
+                    if (slots_.empty()) {
+                        return NotFound;
+                    }
+                    const size_t hash = TermHasher()(term);
+                    for (size_t slot = Home(hash);; slot = (slot + 1) & mask_) {
+                        const TSlot& s = slots_[slot];
+                        if (s.index == EmptySlot) {
+                            return NotFound;
+                        }
+                        if (s.hash == hash && Equals(s.index, term)) {
+                            return s.index;
+                        }
+                    }
+                }
+
+                bool Contains(const Term& term) const noexcept {
+                    return Find(term) != NotFound;
+                }
+
+                // Index of the term and whether it is new.
+                std::pair<size_t, bool> Insert(const Term& term) {
+                    if (2 * (offsets_.size() + 1) > slots_.size()) {
+                        Grow();
+                    }
+                    const size_t hash = TermHasher()(term);
+                    size_t slot = Home(hash);
+                    for (;; slot = (slot + 1) & mask_) {
+                        const TSlot& s = slots_[slot];
+                        if (s.index == EmptySlot) {
+                            break;
+                        }
+                        if (s.hash == hash && Equals(s.index, term)) {
+                            return {s.index, false};
+                        }
+                    }
+                    slots_[slot] = {hash, static_cast<uint32_t>(offsets_.size())};
+                    offsets_.push_back(exponents_.size());
+                    const std::vector<uint16_t>& data = term.GetData();
+                    exponents_.insert(exponents_.end(), data.begin(), data.end());
+                    return {offsets_.size() - 1, true};
+                }
+
+                void Reserve(size_t n) {
+                    offsets_.reserve(n);
+                    while (2 * n > slots_.size()) {
+                        Grow();
+                    }
+                }
+
+                void Clear() noexcept {
+                    offsets_.clear();
+                    exponents_.clear();
+                    for (auto& s : slots_) {
+                        s.index = EmptySlot;
+                    }
+                }
+
+            private:
+                static constexpr uint32_t EmptySlot = static_cast<uint32_t>(-1);
+
+                struct TSlot {
+                    size_t hash;
+                    uint32_t index = EmptySlot;
+                };
+
+                size_t End(size_t i) const noexcept {
+                    return i + 1 < offsets_.size() ? offsets_[i + 1] : exponents_.size();
+                }
+
+                bool Equals(size_t i, const Term& term) const noexcept {
+                    const std::vector<uint16_t>& data = term.GetData();
+                    return End(i) - offsets_[i] == data.size() && std::equal(data.begin(), data.end(), exponents_.begin() + offsets_[i]);
+                }
+
+                // Fibonacci hashing, so the home slot depends on all bits of the hash.
+                size_t Home(size_t hash) const noexcept {
+                    return (hash * 0x9e3779b97f4a7c15ull) >> shift_;
+                }
+
+                void Grow() {
+                    std::vector<TSlot> old(slots_.empty() ? 16 : 2 * slots_.size());
+                    old.swap(slots_);
+                    mask_ = slots_.size() - 1;
+                    shift_ = 64;
+                    for (size_t size = slots_.size(); size > 1; size /= 2) {
+                        shift_--;
+                    }
+                    for (const auto& s : old) {
+                        if (s.index == EmptySlot) {
+                            continue;
+                        }
+                        size_t slot = Home(s.hash);
+                        while (slots_[slot].index != EmptySlot) {
+                            slot = (slot + 1) & mask_;
+                        }
+                        slots_[slot] = s;
+                    }
+                }
+
+                std::vector<TSlot> slots_;
+                std::vector<size_t> offsets_; // start of term i in exponents_
+                std::vector<uint16_t> exponents_;
+                size_t mask_ = 0;
+                int shift_ = 64;
+        };
+
+        // Map from terms on top of TermHashSet, values are stored by the index of their term.
+        template <typename TValue>
+        class TermHashMap {
+            public:
+                size_t Size() const noexcept {
+                    return keys_.Size();
+                }
+
+                const TValue* Find(const Term& term) const noexcept {
+                    const size_t i = keys_.Find(term);
+                    return i == TermHashSet::NotFound ? nullptr : &values_[i];
+                }
+
+                // Inserts the value if the term is new, returns the value of the term and whether it is new.
+                std::pair<TValue*, bool> Insert(const Term& term, TValue value) {
+                    auto [i, inserted] = keys_.Insert(term);
+                    if (inserted) {
+                        values_.push_back(std::move(value));
+                    }
+                    return {&values_[i], inserted};
+                }
+
+                void Reserve(size_t n) {
+                    keys_.Reserve(n);
+                    values_.reserve(n);
+                }
+
+                void Clear() noexcept {
+                    keys_.Clear();
+                    values_.clear();
+                }
+
+            private:
+                TermHashSet keys_;
+                std::vector<TValue> values_;
+        };
+    }
+}
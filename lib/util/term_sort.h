@@ -0,0 +1,107 @@
+#pragma once
+#include "term.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+namespace FF4 {
+    namespace NUtils {
+        template <typename TComp>
+        concept COrderKey = requires(const Term& term, uint16_t* digits) {
+            { TComp::OrderKey(term, size_t(), digits) } -> std::convertible_to<size_t>;
+        };
+
+        // Sorts the terms by TComp. If the order gives integer keys, the digits of the keys are shifted by their
+        // minimum and packed with the bits their range needs into 64 bit words, which are sorted by LSD radix sort
+        // skipping the bytes that are equal in all keys. Otherwise it is a comparison sort.
+        template <typename TComp>
+        void SortTerms(std::vector<Term>& terms, ThreadPool& pool) {
+            if constexpr (!COrderKey<TComp>) {
+                ParallelSort(terms.begin(), terms.end(), TComp(), pool);
+            } else {
+                const size_t n = terms.size();
+                if (n < 2) {
+                    return;
+                }
+                size_t variables = 0;
+                for (const auto& term : terms) {
+                    variables = std::max(variables, term.size());
+                }
+                const size_t width = variables + 1;
+                std::vector<uint16_t> digits(n * width);
+                const size_t chunk = (n + pool.Size() - 1) / pool.Size();
+                std::vector<size_t> counts(pool.Size());
+                pool.ParallelFor(pool.Size(), [&](size_t, size_t task) {
+                    for (size_t i = task * chunk; i < std::min(n, (task + 1) * chunk); i++) {
+                        counts[task] = TComp::OrderKey(terms[i], variables, &digits[i * width]);
+                    }
+                });
+                const size_t m = *std::max_element(counts.begin(), counts.end());
+
+                // Bits of each digit above its minimum, the least significant digit goes to the lowest bits.
+                std::vector<uint16_t> low(m, UINT16_MAX);
+                std::vector<uint16_t> high(m, 0);
+                for (size_t i = 0; i < n; i++) {
+                    for (size_t d = 0; d < m; d++) {
+                        low[d] = std::min(low[d], digits[i * width + d]);
+                        high[d] = std::max(high[d], digits[i * width + d]);
+                    }
+                }
+                std::vector<std::pair<size_t, size_t>> place(m);
+                size_t words = 1;
+                for (size_t d = m, bit = 0; d-- > 0;) {
+                    const size_t bits = std::bit_width(static_cast<unsigned>(high[d] - low[d]));
+                    if (bit + bits > 64) {
+                        words++;
+                        bit = 0;
+                    }
+                    place[d] = {words - 1, bit};
+                    bit += bits;
+                }
+                std::vector<uint64_t> keys(n * words);
+                pool.ParallelFor(pool.Size(), [&](size_t, size_t task) {
+                    for (size_t i = task * chunk; i < std::min(n, (task + 1) * chunk); i++) {
+                        for (size_t d = 0; d < m; d++) {
+                            keys[i * words + place[d].first] |= uint64_t(digits[i * width + d] - low[d]) << place[d].second;
+                        }
+                    }
+                });
+
+                std::vector<uint32_t> order(n);
+                std::vector<uint32_t> buffer(n);
+                std::iota(order.begin(), order.end(), 0);
+                size_t count[256];
+                for (size_t word = 0; word < words; word++) {
+                    for (size_t shift = 0; shift < 64; shift += 8) {
+                        std::fill(count, count + 256, 0);
+                        for (size_t i = 0; i < n; i++) {
+                            count[(keys[i * words + word] >> shift) & 255]++;
+                        }
+                        if (count[(keys[word] >> shift) & 255] == n) {
+                            continue;
+                        }
+                        for (size_t b = 0, sum = 0; b < 256; b++) {
+                            const size_t c = count[b];
+                            count[b] = sum;
+                            sum += c;
+                        }
+                        for (size_t i = 0; i < n; i++) {
+                            buffer[count[(keys[order[i] * words + word] >> shift) & 255]++] = order[i];
+                        }
+                        order.swap(buffer);
+                    }
+                }
+
+                std::vector<Term> sorted;
+                sorted.reserve(n);
+                for (auto i : order) {
+                    sorted.push_back(std::move(terms[i]));
+                }
+                terms.swap(sorted);
+            }
+        }
+    }
+}
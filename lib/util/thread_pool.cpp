@@ -0,0 +1,75 @@
+#include "thread_pool.h"
+
+namespace FF4 {
+    namespace NUtils {
+        ThreadPool::ThreadPool(size_t threads) {
+            for (size_t i = 1; i < threads; i++) {
+                workers_.emplace_back(&ThreadPool::Work, this, i);
+            }
+        }
+
+        ThreadPool::~ThreadPool() {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stop_ = true;
+            }
+            start_.notify_all();
+            for (auto& worker : workers_) {
+                worker.join();
+            }
+        }
+
+        size_t ThreadPool::Size() const noexcept {
+            return workers_.size() + 1;
+        }
+
+        void ThreadPool::ParallelFor(size_t tasks, const TTask& task) {
+            if (workers_.empty() || tasks <= 1) {
+                for (size_t i = 0; i < tasks; i++) {
+                    task(0, i);
+                }
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                task_ = &task;
+                tasks_ = tasks;
+                next_ = 0;
+                running_ = workers_.size();
+                generation_++;
+            }
+            start_.notify_all();
+            RunTasks(0);
+
+            std::unique_lock<std::mutex> lock(mutex_);
+            done_.wait(lock, [this] { return running_ == 0; });
+            task_ = nullptr;
+        }
+
+        void ThreadPool::Work(size_t worker) {
+            size_t generation = 0;
+            while (true) {
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    start_.wait(lock, [this, generation] { return stop_ || generation_ != generation; });
+                    if (stop_) {
+                        return;
+                    }
+                    generation = generation_;
+                }
+                RunTasks(worker);
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    running_--;
+                }
+                done_.notify_one();
+            }
+        }
+
+        void ThreadPool::RunTasks(size_t worker) {
+            for (size_t i = next_++; i < tasks_; i = next_++) {
+                (*task_)(worker, i);
+            }
+        }
+    }
+}
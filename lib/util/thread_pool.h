@@ -0,0 +1,66 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace FF4 {
+    namespace NUtils {
+        // Fork-join pool. The calling thread takes part in the work as worker 0.
+        class ThreadPool {
+        public:
+            using TTask = std::function<void(size_t worker, size_t task)>;
+
+            explicit ThreadPool(size_t threads);
+            ~ThreadPool();
+
+            ThreadPool(const ThreadPool&) = delete;
+            ThreadPool& operator=(const ThreadPool&) = delete;
+
+            size_t Size() const noexcept;
+
+            // Runs task(worker, i) for every i in [0, tasks) and waits for all of them.
+            // Tasks are handed out one by one, so uneven tasks are balanced between workers.
+            void ParallelFor(size_t tasks, const TTask& task);
+
+        private:
+            void Work(size_t worker);
+            void RunTasks(size_t worker);
+
+            std::vector<std::thread> workers_;
+            std::mutex mutex_;
+            std::condition_variable start_;
+            std::condition_variable done_;
+            const TTask* task_ = nullptr;
+            size_t tasks_ = 0;
+            std::atomic<size_t> next_ = 0;
+            size_t running_ = 0;
+            size_t generation_ = 0;
+            bool stop_ = false;
+        };
+
+        // std::sort of [begin, end): a chunk per worker is sorted in parallel, then neighbouring runs are merged
+        // in parallel rounds.
+        template <typename TIterator, typename TCompare>
+        void ParallelSort(TIterator begin, TIterator end, TCompare compare, ThreadPool& pool) {
+            const size_t n = end - begin;
+            if (pool.Size() == 1 || n < 4096) {
+                std::sort(begin, end, compare);
+                return;
+            }
+            const size_t chunk = (n + pool.Size() - 1) / pool.Size();
+            pool.ParallelFor(pool.Size(), [&](size_t, size_t task) {
+                std::sort(begin + std::min(n, task * chunk), begin + std::min(n, (task + 1) * chunk), compare);
+            });
+            for (size_t width = chunk; width < n; width *= 2) {
+                pool.ParallelFor((n + 2 * width - 1) / (2 * width), [&](size_t, size_t task) {
+                    const size_t first = task * 2 * width;
+                    std::inplace_merge(begin + first, begin + std::min(n, first + width), begin + std::min(n, first + 2 * width), compare);
+                });
+            }
+        }
+    }
+}
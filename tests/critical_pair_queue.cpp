@@ -0,0 +1,103 @@
+#include "../lib/algo/util/critical_pair_queue.h"
+#include "../lib/util/comp.h"
+#include "../lib/util/prime_field.h"
+#include <iostream>
+#include <cassert>
+
+void test_critical_pair_queue() {
+    using namespace FF4::NUtils;
+    using TPolynomial = Polynomial<PrimeField<31>, GrevLexComp>;
+    using TQueue = FF4::NAlgo::NUtil::CriticalPairQueue<PrimeField<31>, GrevLexComp>;
+    auto make = [](Term term) {
+        return TPolynomial(std::vector<Monomial<PrimeField<31>>>{Monomial(term, PrimeField<31>(1))});
+    };
+
+    // (x^2, y^2) has coprime leading terms, (x^2, z^2) and (y^2, z^2) too, lcm(x^2, xy) divides nothing else.
+    {
+        TPolynomial a = make(Term({2})), b = make(Term({1, 1})), c = make(Term({0, 2})), d = make(Term({0, 0, 2}));
+        TQueue queue;
+        for (const auto* f : {&a, &b, &c, &d}) {
+            queue.Insert(*f, f->GetLeadingTerm().TotalDegree());
+        }
+        assert(queue.Size() == 2);
+        std::vector<TQueue::TPair> pairs;
+        queue.TakeLowest(pairs);
+        assert(pairs.size() == 2 && queue.Empty());
+        for (const auto& pair : pairs) {
+            assert(pair.degree == 3);
+            assert(&queue.GetLeft(pair) == &b || &queue.GetRight(pair) == &b);
+        }
+    }
+
+    // The old pair (x^2 y, x y^2) goes, x y divides its lcm and gives pairs of lower lcm. Then x^2 y is a multiple
+    // of x y and gets no pair with z x^2.
+    {
+        TPolynomial a = make(Term({2, 1})), b = make(Term({1, 2})), c = make(Term({1, 1})), d = make(Term({2, 0, 1}));
+        TQueue queue;
+        queue.Insert(a, a.GetLeadingTerm().TotalDegree());
+        queue.Insert(b, b.GetLeadingTerm().TotalDegree());
+        assert(queue.Size() == 1);
+        queue.Insert(c, c.GetLeadingTerm().TotalDegree());
+        assert(queue.Size() == 2);
+        queue.Insert(d, d.GetLeadingTerm().TotalDegree());
+        std::vector<TQueue::TPair> pairs;
+        size_t degree = 0;
+        while (!queue.Empty()) {
+            queue.TakeLowest(pairs);
+            for (const auto& pair : pairs) {
+                assert(pair.degree >= degree);
+                degree = pair.degree;
+                assert(&queue.GetLeft(pair) != &b || &queue.GetRight(pair) != &a);
+                assert(&queue.GetRight(pair) != &d || &queue.GetLeft(pair) != &a);
+            }
+        }
+    }
+
+    // x^2 + 1 of sugar 5 and x y: the pair has lcm degree 3 and sugar 5 + 1 = 6, the sugar queue files it under 6.
+    // Then (x y, y^2) and (x y, x z) of sugar 3 come before (x^2, x z) of sugar 6, a cap takes them one at a time.
+    {
+        TPolynomial a = make(Term({2})), b = make(Term({1, 1})), c = make(Term({0, 2})), d = make(Term({1, 0, 1}));
+        TQueue queue(FF4::NAlgo::NUtil::ESelectionStrategy::Sugar);
+        queue.Insert(a, 5);
+        queue.Insert(b, 2);
+        std::vector<TQueue::TPair> pairs;
+        queue.TakeLowest(pairs);
+        assert(pairs.size() == 1 && pairs[0].degree == 3 && pairs[0].sugar == 6);
+
+        queue.Insert(c, 2);
+        queue.Insert(d, 2);
+        assert(queue.Size() == 3);
+        queue.TakeLowest(pairs, 1);
+        assert(pairs.size() == 1 && &queue.GetLeft(pairs[0]) == &b && &queue.GetRight(pairs[0]) == &c);
+        queue.TakeLowest(pairs, 1);
+        assert(pairs.size() == 1 && &queue.GetLeft(pairs[0]) == &b && &queue.GetRight(pairs[0]) == &d);
+        queue.TakeLowest(pairs, 1);
+        assert(pairs.size() == 1 && &queue.GetLeft(pairs[0]) == &a && pairs[0].sugar == 6 && queue.Empty());
+    }
+
+    // The B criterion skips the pairs already taken from a bucket: after (x y, y^2) is taken, x removes
+    // (x y, x z) from the rest of the bucket.
+    {
+        TPolynomial a = make(Term({2})), b = make(Term({1, 1})), c = make(Term({0, 2})), d = make(Term({1, 0, 1})), e = make(Term({1}));
+        TQueue queue(FF4::NAlgo::NUtil::ESelectionStrategy::Sugar);
+        queue.Insert(a, 5);
+        queue.Insert(b, 2);
+        queue.Insert(c, 2);
+        queue.Insert(d, 2);
+        std::vector<TQueue::TPair> pairs;
+        queue.TakeLowest(pairs, 1);
+        assert(&queue.GetLeft(pairs[0]) == &b && &queue.GetRight(pairs[0]) == &c);
+        queue.Insert(e, 1);
+        const size_t size = queue.Size();
+        size_t taken = 0;
+        while (!queue.Empty()) {
+            queue.TakeLowest(pairs, 1);
+            taken += pairs.size();
+            for (const auto& pair : pairs) {
+                assert(&queue.GetLeft(pair) != &b || (&queue.GetRight(pair) != &c && &queue.GetRight(pair) != &d));
+            }
+        }
+        assert(taken == size);
+    }
+    std::cout << "Successfully tested Critical pair queue" << std::endl;
+}
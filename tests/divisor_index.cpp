@@ -0,0 +1,79 @@
+#include "../lib/algo/util/divisor_index.h"
+#include "../lib/util/comp.h"
+#include "../lib/util/prime_field.h"
+#include <iostream>
+#include <algorithm>
+#include <cassert>
+#include <random>
+#include <set>
+
+namespace {
+    // Term in the first variables of five with exponents up to degree.
+    FF4::NUtils::Term random_term(std::mt19937& rng, size_t variables, uint16_t degree) {
+        uint16_t e[5] = {};
+        for (size_t i = 0; i < variables; i++) {
+            e[i] = rng() % (degree + 1);
+        }
+        return FF4::NUtils::Term({e[0], e[1], e[2], e[3], e[4]});
+    }
+
+    template <typename TComp>
+    void test_divisor_index(std::mt19937& rng) {
+        using namespace FF4::NUtils;
+        using FF4::NAlgo::NUtil::EReducerChoice;
+        using TPolynomial = Polynomial<PrimeField<31>, TComp>;
+        for (size_t test = 0; test < 50; test++) {
+            std::set<TPolynomial, TComp> basis;
+            std::vector<const TPolynomial*> inserted;
+            FF4::NAlgo::NUtil::DivisorIndex<PrimeField<31>, TComp> index;
+            for (size_t k = rng() % 30; k > 0; k--) {
+                std::vector<Monomial<PrimeField<31>>> monomials;
+                monomials.emplace_back(random_term(rng, 4, 3), PrimeField<31>(1));
+                for (size_t tail = rng() % 4; tail > 0; tail--) {
+                    Term term = random_term(rng, 4, 3);
+                    if (TComp()(term, monomials.back().GetTerm())) {
+                        monomials.emplace_back(term, PrimeField<31>(1));
+                    }
+                }
+                auto [it, is_new] = basis.insert(TPolynomial(std::move(monomials)));
+                index.Insert(*it);
+                if (is_new) {
+                    inserted.push_back(&*it);
+                }
+            }
+            assert(index.Size() == basis.size());
+
+            // Divisors in the order of the set, the first one wins ties.
+            auto expected = [&](const Term& t, EReducerChoice choice) {
+                const TPolynomial* best = nullptr;
+                for (const auto& f : basis) {
+                    if (!t.IsDivisibleBy(f.GetLeadingTerm())) {
+                        continue;
+                    }
+                    const size_t order = std::find(inserted.begin(), inserted.end(), &f) - inserted.begin();
+                    const size_t best_order = std::find(inserted.begin(), inserted.end(), best) - inserted.begin();
+                    if (!best
+                        || (choice == EReducerChoice::Sparsest && f.GetMonomials().size() < best->GetMonomials().size())
+                        || (choice == EReducerChoice::Newest && order > best_order)
+                        || (choice == EReducerChoice::LowestMultiplier && f.GetLeadingTerm().TotalDegree() > best->GetLeadingTerm().TotalDegree())) {
+                        best = &f;
+                    }
+                }
+                return best;
+            };
+            for (size_t query = 0; query < 50; query++) {
+                const Term t = random_term(rng, 5, 5);
+                for (auto choice : {EReducerChoice::Least, EReducerChoice::Sparsest, EReducerChoice::Newest, EReducerChoice::LowestMultiplier}) {
+                    assert(index.FindDivisor(t, choice) == expected(t, choice));
+                }
+            }
+        }
+    }
+}
+
+void test_divisor_index() {
+    std::mt19937 rng(43);
+    test_divisor_index<FF4::NUtils::GrevLexComp>(rng);
+    test_divisor_index<FF4::NUtils::LexComp>(rng);
+    std::cout << "Successfully tested Divisor index" << std::endl;
+}
@@ -5,6 +5,54 @@
 #include "../lib/util/prime_field.h"
 #include "../lib/algo/util/groebner_basis_util.h"
 
+namespace {
+    // Runs F4 with every option set on input. The options which keep the reduced basis must give expected, the
+    // others only a Groebner basis.
+    template <typename TCoef, typename TComp>
+    void test_options(const FF4::NUtils::TPolynomials<TCoef, TComp>& input, const FF4::NUtils::TPolynomials<TCoef, TComp>& expected) {
+        using namespace FF4::NAlgo;
+        NUtil::TMatrixReductionStats stats;
+        const std::vector<std::pair<F4::TOptions, bool>> cases = {
+            {{.matrix = {.threads = 4}}, true},
+            {{.matrix = {.storage = NUtil::ERowStorage::Hybrid}}, true},
+            {{.matrix = {.tiled_elimination_bytes = 0}}, true},
+            {{.matrix = {.echelon = NUtil::EEchelonForm::RowEchelon}}, false},
+            {{.matrix = {.failure_probability = 1e-9}}, true},
+            {{.matrix = {}, .simplify = true}, true},
+            {{.matrix = {.storage = NUtil::ERowStorage::Hybrid}, .simplify = true}, true},
+            {{.matrix = {.failure_probability = 1e-9}, .simplify = true}, true},
+            {{.matrix = {.split_components = false}}, true},
+            {{.matrix = {.memory_budget = 1}}, true},
+            {{.matrix = {.stats = &stats}, .reducer = NUtil::EReducerChoice::Sparsest}, false},
+            {{.matrix = {.stats = &stats}, .reducer = NUtil::EReducerChoice::Newest}, false},
+            {{.matrix = {.stats = &stats}, .reducer = NUtil::EReducerChoice::LowestMultiplier}, false},
+            {{.matrix = {}, .selection = NUtil::ESelectionStrategy::Sugar}, false},
+            {{.matrix = {}, .max_pairs = 1}, false},
+            {{.matrix = {}, .selection = NUtil::ESelectionStrategy::Sugar, .max_pairs = 1}, false},
+        };
+        for (const auto& [options, same] : cases) {
+            FF4::NUtils::TPolynomials<TCoef, TComp> test = input;
+            F4::FindGroebnerBasis(test, options);
+            assert(same ? test == expected : NUtil::CheckBasisIsGroebner(test));
+        }
+        assert(stats.reducers > 0 && stats.reducer_terms >= stats.reducers && stats.entries > stats.reducer_terms);
+
+        // A mapped D is echelonized with the same row operations as a D in memory.
+        NUtil::TMatrixReductionStats plain_stats, mapped_stats;
+        FF4::NUtils::TPolynomials<TCoef, TComp> plain = input, mapped = input;
+        F4::FindGroebnerBasis(plain, {.matrix = {.threads = 4, .stats = &plain_stats}});
+        F4::FindGroebnerBasis(mapped, {.matrix = {.threads = 4, .stats = &mapped_stats, .memory_budget = 1}});
+        assert(mapped == expected && mapped_stats.row_operations > 0);
+        assert(mapped_stats.row_operations == plain_stats.row_operations && mapped_stats.fill_in == plain_stats.fill_in);
+
+        // Reducers started from the reduced pivot rows of earlier matrices take fewer row operations in all.
+        NUtil::TMatrixReductionStats simplify_stats;
+        FF4::NUtils::TPolynomials<TCoef, TComp> simplified = input;
+        F4::FindGroebnerBasis(simplified, {.matrix = {.threads = 4, .stats = &simplify_stats}, .simplify = true});
+        assert(simplified == expected && simplify_stats.row_operations < plain_stats.row_operations);
+    }
+}
+
 void test_f4() {
     using namespace FF4::NUtils;
     // cyclic-4
@@ -86,6 +134,34 @@ void test_f4() {
         assert(FF4::NAlgo::NUtil::CheckBasisIsGroebner(test));
     }
 
+    // pairs sharing a half
+    {
+        using TPolynomial = Polynomial<PrimeField<31>, GrevLexComp>;
+        TPolynomial f(std::vector<Monomial<PrimeField<31>>>{Monomial(Term({1, 1}), PrimeField<31>(1)), Monomial(Term({0}), PrimeField<31>(1))});
+        TPolynomial g(std::vector<Monomial<PrimeField<31>>>{Monomial(Term({2}), PrimeField<31>(1)), Monomial(Term({0, 1}), PrimeField<31>(1))});
+        TPolynomial h(std::vector<Monomial<PrimeField<31>>>{Monomial(Term({2}), PrimeField<31>(1)), Monomial(Term({0}), PrimeField<31>(1))});
+
+        FF4::NAlgo::F4::TPairsVector<PrimeField<31>, GrevLexComp> selected = {CriticalPair(f, g), CriticalPair(f, h)};
+        FF4::NAlgo::NUtil::DivisorIndex<PrimeField<31>, GrevLexComp> divisors;
+        ThreadPool pool(1);
+        std::vector<TermHashSet> known;
+        auto [L, columns] = FF4::NAlgo::F4::SymbolicPreprocessing(selected, divisors, pool, known);
+        assert(L.size() == 3);
+        assert(std::count_if(L.begin(), L.end(), [&f](const auto& row) { return row.polynomial == &f; }) == 1);
+
+        // the parallel closure finds the same reducers and columns
+        for (const auto* p : {&f, &g, &h}) {
+            divisors.Insert(*p);
+        }
+        ThreadPool parallel_pool(4);
+        FF4::NAlgo::F4::TPairsVector<PrimeField<31>, GrevLexComp> serial_selected = {CriticalPair(f, g), CriticalPair(f, h)};
+        FF4::NAlgo::F4::TPairsVector<PrimeField<31>, GrevLexComp> parallel_selected = {CriticalPair(f, g), CriticalPair(f, h)};
+        auto [serial_L, serial_columns] = FF4::NAlgo::F4::SymbolicPreprocessing(serial_selected, divisors, pool, known);
+        auto [parallel_L, parallel_columns] = FF4::NAlgo::F4::SymbolicPreprocessing(parallel_selected, divisors, parallel_pool, known);
+        assert(serial_columns == parallel_columns);
+        assert(serial_L.size() == parallel_L.size());
+    }
+
     // katsura4
     {
         std::vector<Monomial<PrimeField<31>>> amon;
@@ -128,6 +204,59 @@ void test_f4() {
         std::cout << "Size of Groebner basis by F4: " << test.size() << std::endl;
         std::cout << test << std::endl;
         assert(FF4::NAlgo::NUtil::CheckBasisIsGroebner(test));
+
+        test_options(TPolynomials<PrimeField<31>, GrevLexComp>{a, b, c, d}, test);
+    }
+
+    // cyclic-5-prime-field
+    {
+        std::vector<Monomial<PrimeField<32003>>> amon;
+        amon.push_back(Monomial(Term({1, 1, 1, 1, 1}), PrimeField<32003>(1)));
+        amon.push_back(Monomial(Term({0}), PrimeField<32003>(-1)));
+
+        Polynomial<PrimeField<32003>, GrevLexComp> a(std::move(amon));
+
+        std::vector<Monomial<PrimeField<32003>>> bmon;
+        bmon.push_back(Monomial(Term({1, 1, 1, 1}), PrimeField<32003>(1)));
+        bmon.push_back(Monomial(Term({1, 1, 1, 0, 1}), PrimeField<32003>(1)));
+        bmon.push_back(Monomial(Term({1, 1, 0, 1, 1}), PrimeField<32003>(1)));
+        bmon.push_back(Monomial(Term({1, 0, 1, 1, 1}), PrimeField<32003>(1)));
+        bmon.push_back(Monomial(Term({0, 1, 1, 1, 1}), PrimeField<32003>(1)));
+
+        Polynomial<PrimeField<32003>, GrevLexComp> b(std::move(bmon));
+
+        std::vector<Monomial<PrimeField<32003>>> cmon;
+        cmon.push_back(Monomial(Term({1, 1, 1}), PrimeField<32003>(1)));
+        cmon.push_back(Monomial(Term({0, 1, 1, 1}), PrimeField<32003>(1)));
+        cmon.push_back(Monomial(Term({1, 1, 0, 0, 1}), PrimeField<32003>(1)));
+        cmon.push_back(Monomial(Term({1, 0, 0, 1, 1}), PrimeField<32003>(1)));
+        cmon.push_back(Monomial(Term({0, 0, 1, 1, 1}), PrimeField<32003>(1)));
+
+        Polynomial<PrimeField<32003>, GrevLexComp> c(std::move(cmon));
+
+        std::vector<Monomial<PrimeField<32003>>> dmon;
+        dmon.push_back(Monomial(Term({1, 1}), PrimeField<32003>(1)));
+        dmon.push_back(Monomial(Term({0, 1, 1}), PrimeField<32003>(1)));
+        dmon.push_back(Monomial(Term({0, 0, 1, 1}), PrimeField<32003>(1)));
+        dmon.push_back(Monomial(Term({1, 0, 0, 0, 1}), PrimeField<32003>(1)));
+        dmon.push_back(Monomial(Term({0, 0, 0, 1, 1}), PrimeField<32003>(1)));
+
+        Polynomial<PrimeField<32003>, GrevLexComp> d(std::move(dmon));
+
+        std::vector<Monomial<PrimeField<32003>>> emon;
+        emon.push_back(Monomial(Term({1}), PrimeField<32003>(1)));
+        emon.push_back(Monomial(Term({0, 1}), PrimeField<32003>(1)));
+        emon.push_back(Monomial(Term({0, 0, 1}), PrimeField<32003>(1)));
+        emon.push_back(Monomial(Term({0, 0, 0, 1}), PrimeField<32003>(1)));
+        emon.push_back(Monomial(Term({0, 0, 0, 0, 1}), PrimeField<32003>(1)));
+
+        Polynomial<PrimeField<32003>, GrevLexComp> e(std::move(emon));
+
+        TPolynomials<PrimeField<32003>, GrevLexComp> test = {a, b, c, d, e};
+        FF4::NAlgo::F4::FindGroebnerBasis(test);
+        std::cout << "Size of Groebner basis by F4: " << test.size() << std::endl;
+        assert(FF4::NAlgo::NUtil::CheckBasisIsGroebner(test));
+        test_options(TPolynomials<PrimeField<32003>, GrevLexComp>{a, b, c, d, e}, test);
     }
 
     // sym3-3
@@ -1,17 +1,29 @@
 #include "buchberger.cpp"
+#include "critical_pair_queue.cpp"
+#include "divisor_index.cpp"
 #include "f4.cpp"
+#include "matrix_reduction.cpp"
 #include "monomial.cpp"
 #include "polynomial.cpp"
 #include "prime_field.cpp"
 #include "rational.cpp"
+#include "row_operations.cpp"
 #include "term.cpp"
+#include "term_hash_set.cpp"
+#include "term_sort.cpp"
 
 int main() {
     test_prime_field();
     test_rational();
+    test_row_operations();
     test_term();
+    test_term_hash_set();
+    test_term_sort();
     test_monomial();
     test_polynomial();
+    test_matrix_reduction();
+    test_divisor_index();
+    test_critical_pair_queue();
     test_buchberger();
     test_f4();
 }
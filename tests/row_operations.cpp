@@ -0,0 +1,168 @@
+#include "../lib/util/row_operations.h"
+#include "../lib/util/prime_field.h"
+#include "../lib/util/rational.h"
+#include "testing.h"
+#include <iostream>
+#include <algorithm>
+#include <cassert>
+#include <numeric>
+#include <random>
+#include <vector>
+
+namespace {
+    template <typename TCoef>
+    void test_subtract_multiple(std::mt19937& rng, int32_t mod) {
+        // Rows start at every offset from the vector alignment, the kernels go scalar up to it.
+        for (size_t n = 0; n < 70; n++) {
+            const size_t row_offset = rng() % 16;
+            const size_t pivot_offset = rng() % 2 ? row_offset : rng() % 16;
+            std::vector<TCoef> row(n + row_offset), pivot(n + pivot_offset);
+            for (auto& x : row) {
+                x = TCoef(rng() % mod);
+            }
+            for (auto& x : pivot) {
+                x = TCoef(rng() % mod);
+            }
+            TCoef factor(rng() % mod);
+            std::vector<TCoef> expected = row;
+            for (size_t i = 0; i < n; i++) {
+                expected[row_offset + i] -= factor * pivot[pivot_offset + i];
+            }
+            FF4::NUtils::SubtractMultiple(row.data() + row_offset, pivot.data() + pivot_offset, factor, n);
+            for (size_t i = 0; i < row.size(); i++) {
+                ASSERT_EQUAL(row[i], expected[i]);
+            }
+        }
+    }
+
+    template <typename TCoef>
+    void test_subtract_multiple_sparse(std::mt19937& rng, int32_t mod) {
+        for (size_t n = 0; n < 70; n++) {
+            std::vector<TCoef> row(2 * n + 1);
+            for (auto& x : row) {
+                x = TCoef(rng() % mod);
+            }
+            std::vector<uint32_t> columns(row.size());
+            std::iota(columns.begin(), columns.end(), 0);
+            std::shuffle(columns.begin(), columns.end(), rng);
+            columns.resize(n);
+            std::vector<TCoef> values(n);
+            for (auto& x : values) {
+                x = TCoef(rng() % mod);
+            }
+            TCoef factor(rng() % mod);
+            std::vector<TCoef> expected = row;
+            for (size_t i = 0; i < n; i++) {
+                expected[columns[i]] -= factor * values[i];
+            }
+            FF4::NUtils::SubtractMultipleSparse(row.data(), columns.data(), values.data(), factor, n);
+            for (size_t i = 0; i < row.size(); i++) {
+                ASSERT_EQUAL(row[i], expected[i]);
+            }
+        }
+    }
+
+    using TDenseKernel = void (*)(uint32_t*, const uint32_t*, uint32_t, uint32_t, size_t) noexcept;
+    using TSparseKernel = void (*)(uint32_t*, const uint32_t*, const uint32_t*, uint32_t, uint32_t, size_t) noexcept;
+
+    constexpr uint32_t kernel_primes[] = {2, 31, 1000000007, 2013265921, 2147483647};
+
+    // Residues at both ends of [0, p) are as likely as the rest, they hit the corrections of the reduction.
+    uint32_t random_residue(std::mt19937& rng, uint32_t p) {
+        switch (rng() % 3) {
+            case 0:
+                return rng() % std::min<uint32_t>(p, 2);
+            case 1:
+                return p - 1 - rng() % std::min<uint32_t>(p, 2);
+            default:
+                return rng() % p;
+        }
+    }
+
+    uint32_t subtract_product(uint32_t y, uint32_t x, uint32_t factor, uint32_t p) {
+        return (uint64_t(y) + p - uint64_t(x) * factor % p) % p;
+    }
+
+    // A kernel against 64 bit arithmetic on lengths around the vector widths, at every offset from the alignment.
+    void test_dense_kernel(TDenseKernel kernel, std::mt19937& rng) {
+        for (uint32_t p : kernel_primes) {
+            for (size_t n = 0; n < 70; n++) {
+                const size_t row_offset = rng() % 16;
+                const size_t pivot_offset = rng() % 2 ? row_offset : rng() % 16;
+                std::vector<uint32_t> row(n + row_offset), pivot(n + pivot_offset);
+                for (auto& x : row) {
+                    x = random_residue(rng, p);
+                }
+                for (auto& x : pivot) {
+                    x = random_residue(rng, p);
+                }
+                const uint32_t factor = random_residue(rng, p);
+                std::vector<uint32_t> expected = row;
+                for (size_t i = 0; i < n; i++) {
+                    expected[row_offset + i] = subtract_product(row[row_offset + i], pivot[pivot_offset + i], factor, p);
+                }
+                kernel(row.data() + row_offset, pivot.data() + pivot_offset, factor, p, n);
+                for (size_t i = 0; i < row.size(); i++) {
+                    ASSERT_EQUAL(row[i], expected[i]);
+                }
+            }
+        }
+    }
+
+    void test_sparse_kernel(TSparseKernel kernel, std::mt19937& rng) {
+        for (uint32_t p : kernel_primes) {
+            for (size_t n = 0; n < 70; n++) {
+                std::vector<uint32_t> row(2 * n + 1);
+                for (auto& x : row) {
+                    x = random_residue(rng, p);
+                }
+                std::vector<uint32_t> columns(row.size());
+                std::iota(columns.begin(), columns.end(), 0);
+                std::shuffle(columns.begin(), columns.end(), rng);
+                columns.resize(n);
+                std::vector<uint32_t> values(n);
+                for (auto& x : values) {
+                    x = random_residue(rng, p);
+                }
+                const uint32_t factor = random_residue(rng, p);
+                std::vector<uint32_t> expected = row;
+                for (size_t i = 0; i < n; i++) {
+                    expected[columns[i]] = subtract_product(row[columns[i]], values[i], factor, p);
+                }
+                kernel(row.data(), columns.data(), values.data(), factor, p, n);
+                for (size_t i = 0; i < row.size(); i++) {
+                    ASSERT_EQUAL(row[i], expected[i]);
+                }
+            }
+        }
+    }
+}
+
+void test_row_operations() {
+    using namespace FF4::NUtils;
+    std::mt19937 rng(7);
+    test_subtract_multiple<PrimeField<31>>(rng, 31);
+    test_subtract_multiple<PrimeField<1000000007>>(rng, 1000000007);
+    test_subtract_multiple<PrimeField<2013265921>>(rng, 2013265921);
+    test_subtract_multiple<Rational>(rng, 100);
+
+    test_subtract_multiple_sparse<PrimeField<31>>(rng, 31);
+    test_subtract_multiple_sparse<PrimeField<1000000007>>(rng, 1000000007);
+    test_subtract_multiple_sparse<Rational>(rng, 100);
+
+    // Every kernel the dispatch can pick, not only the one picked on this CPU.
+    test_dense_kernel(NKernels::SubtractMultipleModPScalar, rng);
+    test_sparse_kernel(NKernels::SubtractMultipleSparseModPScalar, rng);
+#ifdef FF4_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        test_dense_kernel(NKernels::SubtractMultipleModPAvx2, rng);
+    }
+    if (__builtin_cpu_supports("avx512f")) {
+        test_dense_kernel(NKernels::SubtractMultipleModPAvx512, rng);
+        test_sparse_kernel(NKernels::SubtractMultipleSparseModPAvx512, rng);
+    }
+#endif
+
+    std::cout << "Successfully tested Row operations" << std::endl;
+}
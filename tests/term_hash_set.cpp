@@ -0,0 +1,46 @@
+#include "../lib/util/term_hash_set.h"
+#include <iostream>
+#include <cassert>
+#include <random>
+#include <unordered_map>
+
+void test_term_hash_set() {
+    using namespace FF4::NUtils;
+    std::mt19937 rng(46);
+    TermHashSet set;
+    TermHashMap<size_t> map;
+    for (size_t round = 0; round < 3; round++) {
+        set.Clear();
+        map.Clear();
+        std::unordered_map<Term, size_t, TermHasher> expected;
+        std::vector<Term> order;
+        for (size_t k = 0; k < 5000; k++) {
+            Term term({uint16_t(rng() % 7), uint16_t(rng() % 7), uint16_t(rng() % 7), uint16_t(rng() % 7), uint16_t(rng() % 7)});
+            auto [i, inserted] = set.Insert(term);
+            auto [value, map_inserted] = map.Insert(term, k);
+            auto [it, expected_inserted] = expected.emplace(term, order.size());
+            assert(inserted == expected_inserted);
+            assert(map_inserted == expected_inserted);
+            assert(i == it->second);
+            if (inserted) {
+                order.push_back(term);
+            }
+            assert(set.Contains(term));
+            assert(map.Find(term) == value);
+        }
+        assert(set.Size() == order.size());
+        assert(map.Size() == order.size());
+        Term term;
+        for (size_t i = 0; i < order.size(); i++) {
+            set.Get(i, term);
+            assert(term == order[i] && term.TotalDegree() == order[i].TotalDegree());
+            assert(set.Find(order[i]) == i);
+        }
+        assert(!set.Contains(Term({7, 7, 7, 7, 7})));
+        assert(!map.Find(Term({7, 7, 7, 7, 7})));
+    }
+    set.Clear();
+    assert(set.Empty());
+    assert(!set.Contains(Term({0, 0, 0, 0, 0})));
+    std::cout << "Successfully tested Term hash set" << std::endl;
+}
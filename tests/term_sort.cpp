@@ -0,0 +1,45 @@
+#include "../lib/util/comp.h"
+#include "../lib/util/term_sort.h"
+#include <iostream>
+#include <algorithm>
+#include <cassert>
+#include <random>
+
+namespace {
+    // Terms of up to five variables, exponents are spread over the given range so keys take several words.
+    std::vector<FF4::NUtils::Term> random_terms(std::mt19937& rng, size_t n, uint16_t range) {
+        std::vector<FF4::NUtils::Term> terms;
+        for (size_t i = 0; i < n; i++) {
+            uint16_t e[5] = {};
+            for (size_t j = rng() % 6; j-- > 0;) {
+                e[j] = rng() % range;
+            }
+            terms.push_back(FF4::NUtils::Term({e[0], e[1], e[2], e[3], e[4]}));
+        }
+        return terms;
+    }
+
+    template <typename TComp>
+    void test_term_sort(std::mt19937& rng, FF4::NUtils::ThreadPool& pool) {
+        for (uint16_t range : {1, 4, 100, 20000}) {
+            for (size_t n : {0, 1, 7, 5000}) {
+                std::vector<FF4::NUtils::Term> terms = random_terms(rng, n, range);
+                std::vector<FF4::NUtils::Term> expected = terms;
+                std::stable_sort(expected.begin(), expected.end(), TComp());
+                FF4::NUtils::SortTerms<TComp>(terms, pool);
+                assert(terms == expected);
+            }
+        }
+    }
+}
+
+void test_term_sort() {
+    std::mt19937 rng(47);
+    for (size_t threads : {1, 3}) {
+        FF4::NUtils::ThreadPool pool(threads);
+        test_term_sort<FF4::NUtils::LexComp>(rng, pool);
+        test_term_sort<FF4::NUtils::RevLexComp>(rng, pool);
+        test_term_sort<FF4::NUtils::GrevLexComp>(rng, pool);
+    }
+    std::cout << "Successfully tested Term sort" << std::endl;
+}